@@ -0,0 +1,202 @@
+// Description: Vectorised RGB brighten. brighten_rgb works in double
+//              precision, and its rounding differs from exact arithmetic
+//              for millions of (colour, amount) pairs, including amount 0,
+//              so no fixed-point formula reproduces it. Instead the AVX2
+//              kernel evaluates the very same sequence of double
+//              operations on four pixels at a time, which gives
+//              bit-identical results. Halving and doubling are done as
+//              multiplications by 0.5 and 2, which are exact.
+
+#include "aif-brighten.h"
+
+#include <string.h>
+
+#define FALSE 0
+#define TRUE 1
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AIF_BRIGHTEN_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef AIF_BRIGHTEN_X86
+
+// Pixels per vector step; a step reads 16 bytes, so it needs this many
+// pixels (and a bit) of input left
+#define BRIGHTEN_STEP 4
+#define BRIGHTEN_READ_PIXELS 6
+
+// Description: Brighten one channel of four pixels.
+// Params:
+// - c: channel values (0..255) as doubles
+// - k: constant subtracted from each channel
+// - adjusted: adjusted constant added back
+// - scale: 255.0 in every lane
+// Returns: brightened channel values, clamped to 0..255.
+__attribute__((target("avx2")))
+static inline __m128i brighten_channel_avx2(
+    __m256d c,
+    __m256d k,
+    __m256d adjusted,
+    __m256d scale
+) {
+    __m256d v = _mm256_mul_pd(_mm256_add_pd(_mm256_sub_pd(_mm256_div_pd(c, scale), k),
+                                            adjusted),
+                              scale);
+    __m128i n = _mm256_cvttpd_epi32(v);
+    n = _mm_max_epi32(n, _mm_setzero_si128());
+    return _mm_min_epi32(n, _mm_set1_epi32(255));
+}
+
+// Description: Brighten RGB8 pixels four at a time with AVX2.
+// Params:
+// - in: source pixels
+// - out: destination pixels (must not alias in)
+// - n_pixels: pixels available
+// - amount: brighten/darken percentage (-100..100)
+// Returns: number of pixels brightened.
+__attribute__((target("avx2")))
+static size_t brighten_rgb_avx2(
+    const uint8_t *in,
+    uint8_t *out,
+    size_t n_pixels,
+    int amount
+) {
+    const __m128i take_r = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1,
+                                         6, -1, -1, -1, 9, -1, -1, -1);
+    const __m128i take_g = _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1,
+                                         7, -1, -1, -1, 10, -1, -1, -1);
+    const __m128i take_b = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1,
+                                         8, -1, -1, -1, 11, -1, -1, -1);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+                                       10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256d scale = _mm256_set1_pd(255.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d factor = _mm256_set1_pd(1.0 + amount / 100.0);
+
+    size_t i = 0;
+    for (; i + BRIGHTEN_READ_PIXELS <= n_pixels; i += BRIGHTEN_STEP) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(in + i * 3));
+        __m128i r = _mm_shuffle_epi8(px, take_r);
+        __m128i g = _mm_shuffle_epi8(px, take_g);
+        __m128i b = _mm_shuffle_epi8(px, take_b);
+        __m128i hi = _mm_max_epi32(_mm_max_epi32(r, g), b);
+        __m128i lo = _mm_min_epi32(_mm_min_epi32(r, g), b);
+
+        // luminance = ((hi + lo) / 255.0) / 2
+        // chroma = (hi - lo) / 255.0 * 2
+        __m256d luminance = _mm256_mul_pd(
+            _mm256_div_pd(_mm256_cvtepi32_pd(_mm_add_epi32(hi, lo)), scale), half);
+        __m256d chroma = _mm256_mul_pd(
+            _mm256_div_pd(_mm256_cvtepi32_pd(_mm_sub_epi32(hi, lo)), scale), two);
+        __m256d half_chroma = _mm256_mul_pd(chroma, half);
+        __m256d k = _mm256_sub_pd(luminance, half_chroma);
+        __m256d adjusted = _mm256_sub_pd(_mm256_mul_pd(luminance, factor), half_chroma);
+
+        __m128i new_r = brighten_channel_avx2(_mm256_cvtepi32_pd(r), k, adjusted, scale);
+        __m128i new_g = brighten_channel_avx2(_mm256_cvtepi32_pd(g), k, adjusted, scale);
+        __m128i new_b = brighten_channel_avx2(_mm256_cvtepi32_pd(b), k, adjusted, scale);
+
+        __m128i rgb = _mm_or_si128(new_r, _mm_or_si128(_mm_slli_epi32(new_g, 8),
+                                                       _mm_slli_epi32(new_b, 16)));
+        rgb = _mm_shuffle_epi8(rgb, pack);
+        _mm_storel_epi64((__m128i *)(out + i * 3), rgb);
+        uint32_t last = (uint32_t)_mm_extract_epi32(rgb, 2);
+        memcpy(out + i * 3 + 8, &last, sizeof(last));
+    }
+    return i;
+}
+
+#endif
+
+// Description: Check whether RGB brighten has a vector kernel on this CPU.
+// Params: none.
+// Returns: TRUE if aif_brighten_rgb_simd brightens pixels, FALSE if it
+//          always leaves them to brighten_rgb.
+int aif_brighten_rgb_has_simd(void) {
+#ifdef AIF_BRIGHTEN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return TRUE;
+    }
+#endif
+    return FALSE;
+}
+
+// Description: Brighten leading RGB8 pixels with the fastest kernel the
+//              CPU supports; the caller finishes any remaining pixels with
+//              brighten_rgb.
+// Params:
+// - in: source pixels
+// - out: destination pixels (must not alias in)
+// - n_pixels: pixels available
+// - amount: brighten/darken percentage (-100..100)
+// Returns: number of pixels brightened (0 without a vector kernel).
+size_t aif_brighten_rgb_simd(
+    const uint8_t *in,
+    uint8_t *out,
+    size_t n_pixels,
+    int amount
+) {
+#ifdef AIF_BRIGHTEN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return brighten_rgb_avx2(in, out, n_pixels, amount);
+    }
+#endif
+    return 0;
+}
+
+///////////////////////////////
+// PROVIDED CODE
+// It is best you do not modify anything below this line
+///////////////////////////////
+uint32_t brighten_rgb(uint32_t color, int amount) {
+    uint16_t brightest_color = 0;
+    uint16_t darkest_color = 255;
+
+    for (int i = 0; i < 24; i += 8) {
+        uint8_t c = ((color >> i) & 0xff);
+        if (c > brightest_color) {
+            brightest_color = c;
+        }
+
+        if (c < darkest_color) {
+            darkest_color = c;
+        }
+    }
+
+    double luminance = (
+        (brightest_color + darkest_color) / 255.0
+    ) / 2;
+
+    double chroma = (
+        brightest_color - darkest_color
+    ) / 255.0 * 2;
+
+    // Now that we have chroma and luminanace,
+    // we can subtract the constant factor from each component
+    // m = L - C / 2
+    double constant = luminance - chroma / 2;
+
+    // find the new constant
+    luminance *= (1.0 + amount / 100.0);
+
+    double adjusted = luminance - chroma / 2;
+
+    for (int i = 0; i < 24; i += 8) {
+        int16_t new_val = ((color >> i) & 0xff);
+
+        new_val = (((new_val / 255.0) - constant) + adjusted) * 255.0;
+
+        if (new_val > 255) {
+            color |= (0xff << i);
+        } else if (new_val < 0) {
+            color &= ~(0xff << i);
+        } else {
+            color &= ~(0xff << i);
+            color |= (new_val << i);
+        }
+    }
+
+    return color;
+}
@@ -0,0 +1,21 @@
+#ifndef AIF_BRIGHTEN_H
+#define AIF_BRIGHTEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Takes in a RGB color and brightens it by the given percentage amount
+uint32_t brighten_rgb(uint32_t color, int amount);
+
+// Returns TRUE if aif_brighten_rgb_simd has a vector kernel on this CPU
+int aif_brighten_rgb_has_simd(void);
+// Brightens as many leading RGB8 pixels as the CPU's vector units allow,
+// with results identical to brighten_rgb; returns the number of pixels done
+size_t aif_brighten_rgb_simd(
+    const uint8_t *in,
+    uint8_t *out,
+    size_t n_pixels,
+    int amount
+);
+
+#endif
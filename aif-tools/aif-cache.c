@@ -0,0 +1,145 @@
+// Description: Memo table for per-colour RGB transforms. Screenshots and
+//              other synthetic images use few distinct colours, so a
+//              transform such as brighten_rgb only needs to run once per
+//              colour rather than once per pixel.
+//
+//              Each slot packs a used flag, the 24-bit colour and the
+//              24-bit result into one 64-bit word, so slots are read and
+//              claimed with single atomic operations and row tasks on
+//              different threads can share one cache without locks. Two
+//              threads racing to add the same colour both compute it; the
+//              loser simply reads the winner's slot.
+
+#include "aif-cache.h"
+
+#include <stdlib.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Twice as many slots as colours taken, so probes always reach an empty
+// slot
+#define CACHE_SLOT_BITS 16
+#define CACHE_SLOTS (1 << CACHE_SLOT_BITS)
+
+#define SLOT_USED ((uint64_t)1 << 63)
+#define SLOT_COLOUR_SHIFT 24
+#define COLOUR_MASK 0xFFFFFF
+
+// Open-addressed table of packed slots (see above)
+struct aif_rgb_cache {
+    uint64_t slots[CACHE_SLOTS];
+    uint32_t n_colours;
+};
+
+// Description: Home slot of a colour (Fibonacci hashing).
+// Params:
+// - colour: 24-bit colour
+// Returns: slot index.
+static uint32_t cache_slot(uint32_t colour) {
+    return (colour * 2654435761u) >> (32 - CACHE_SLOT_BITS);
+}
+
+// Description: Allocate an empty cache.
+// Params: none.
+// Returns: new cache, or NULL if out of memory.
+struct aif_rgb_cache *aif_rgb_cache_create(void) {
+    return calloc(1, sizeof(struct aif_rgb_cache));
+}
+
+// Description: Free a cache.
+// Params:
+// - cache: cache to free (may be NULL)
+// Returns: void.
+void aif_rgb_cache_destroy(struct aif_rgb_cache *cache) {
+    free(cache);
+}
+
+// Description: Look up the cached result for a colour.
+// Params:
+// - cache: cache to search
+// - colour: 24-bit colour
+// - result: receives the cached result when found
+// Returns: TRUE if the colour is cached, FALSE otherwise.
+int aif_rgb_cache_get(struct aif_rgb_cache *cache, uint32_t colour, uint32_t *result) {
+    uint32_t i = cache_slot(colour);
+    while (1) {
+        uint64_t slot = __atomic_load_n(&cache->slots[i], __ATOMIC_RELAXED);
+        if (slot == 0) {
+            return FALSE;
+        }
+        if (((slot >> SLOT_COLOUR_SHIFT) & COLOUR_MASK) == colour) {
+            *result = slot & COLOUR_MASK;
+            return TRUE;
+        }
+        i = (i + 1) % CACHE_SLOTS;
+    }
+}
+
+// Description: Cache the result for a colour. Does nothing once the cache
+//              is full; at most half the slots are ever used, so probes
+//              always reach an empty slot.
+// Params:
+// - cache: cache to add to
+// - colour: 24-bit colour
+// - result: 24-bit transformed colour
+// Returns: void.
+void aif_rgb_cache_put(struct aif_rgb_cache *cache, uint32_t colour, uint32_t result) {
+    if (aif_rgb_cache_full(cache)) {
+        return;
+    }
+
+    uint64_t entry = SLOT_USED
+                   | ((uint64_t)colour << SLOT_COLOUR_SHIFT)
+                   | (result & COLOUR_MASK);
+    uint32_t i = cache_slot(colour);
+    while (1) {
+        uint64_t slot = 0;
+        if (__atomic_compare_exchange_n(&cache->slots[i], &slot, entry, FALSE,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            __atomic_add_fetch(&cache->n_colours, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        if (((slot >> SLOT_COLOUR_SHIFT) & COLOUR_MASK) == colour) {
+            return;
+        }
+        i = (i + 1) % CACHE_SLOTS;
+    }
+}
+
+// Description: Check whether a cache has stopped taking new colours.
+// Params:
+// - cache: cache to check
+// Returns: TRUE if full, FALSE otherwise.
+int aif_rgb_cache_full(const struct aif_rgb_cache *cache) {
+    return __atomic_load_n(&cache->n_colours, __ATOMIC_RELAXED)
+           >= AIF_RGB_CACHE_MAX_COLOURS;
+}
+
+// Description: Estimate how colourful an image is by counting the distinct
+//              colours among evenly spaced sample pixels.
+// Params:
+// - pixels: RGB8 pixels
+// - n_pixels: number of pixels
+// Returns: distinct colours among the samples (at most
+//          AIF_RGB_SAMPLE_PIXELS), or 0 if out of memory.
+size_t aif_rgb_sample_colours(const uint8_t *pixels, size_t n_pixels) {
+    struct aif_rgb_cache *seen = aif_rgb_cache_create();
+    if (seen == NULL) {
+        return 0;
+    }
+
+    size_t n_samples = AIF_RGB_SAMPLE_PIXELS;
+    if (n_samples > n_pixels) {
+        n_samples = n_pixels;
+    }
+    for (size_t i = 0; i < n_samples; i++) {
+        const uint8_t *p = pixels + (i * (n_pixels / n_samples)) * 3;
+        uint32_t colour = (p[0] << 16) | (p[1] << 8) | p[2];
+        aif_rgb_cache_put(seen, colour, 0);
+    }
+
+    size_t n_colours = seen->n_colours;
+    aif_rgb_cache_destroy(seen);
+    return n_colours;
+}
@@ -0,0 +1,30 @@
+#ifndef AIF_CACHE_H
+#define AIF_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Table of RGB colour -> transformed colour results, safe to share
+// between threads. Once it holds AIF_RGB_CACHE_MAX_COLOURS colours it
+// stops taking new ones and reports itself full.
+#define AIF_RGB_CACHE_MAX_COLOURS (1 << 15)
+
+// Pixels sampled to estimate how many colours an image has
+#define AIF_RGB_SAMPLE_PIXELS 4096
+
+struct aif_rgb_cache;
+
+// Allocates an empty cache; returns NULL if out of memory
+struct aif_rgb_cache *aif_rgb_cache_create(void);
+// Frees a cache (may be NULL)
+void aif_rgb_cache_destroy(struct aif_rgb_cache *cache);
+// Looks up a colour; returns TRUE and sets *result if it is cached
+int aif_rgb_cache_get(struct aif_rgb_cache *cache, uint32_t colour, uint32_t *result);
+// Caches the result for a colour unless the cache is full
+void aif_rgb_cache_put(struct aif_rgb_cache *cache, uint32_t colour, uint32_t result);
+// Returns TRUE once the cache has stopped taking new colours
+int aif_rgb_cache_full(const struct aif_rgb_cache *cache);
+// Counts the distinct colours among evenly spaced samples of RGB8 pixels
+size_t aif_rgb_sample_colours(const uint8_t *pixels, size_t n_pixels);
+
+#endif
@@ -0,0 +1,316 @@
+// Description: Incremental AIF checksum. Bytes are fed in file order and the
+//              two stored checksum bytes are treated as zero.
+//
+//              Both sums are only needed modulo 256, so instead of reducing
+//              after every byte the kernels let wider accumulators wrap and
+//              reduce once at the end. Over a block of n bytes b[0..n-1]:
+//                  sum2 += n * sum1 + sum((n - i) * b[i])
+//                  sum1 += sum(b[i])
+//              which the SIMD kernels evaluate with 16-bit lanes. The same
+//              identity merges checksums of adjacent chunks, so large files
+//              are split and summed on several threads.
+
+#include "aif.h"
+#include "aif-checksum.h"
+#include "aif-pool.h"
+
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AIF_CHECKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+// Blocks shorter than this are not worth the SIMD setup and reduction
+#define SIMD_MIN_BYTES 64
+
+// One parallel file checksum; each chunk is summed independently
+struct checksum_job {
+    const uint8_t *data;
+    uint64_t size;
+    struct aif_checksum *chunks;
+};
+
+// Description: Scalar checksum kernel.
+// Params:
+// - sum1, sum2: running sums, updated in place
+// - buf: bytes to add
+// - n: number of bytes
+// Returns: void.
+static void checksum_block_scalar(
+    uint32_t *sum1,
+    uint32_t *sum2,
+    const uint8_t *buf,
+    size_t n
+) {
+    uint32_t s1 = *sum1;
+    uint32_t s2 = *sum2;
+    for (size_t i = 0; i < n; i++) {
+        s1 += buf[i];
+        s2 += s1;
+    }
+    *sum1 = s1;
+    *sum2 = s2;
+}
+
+#ifdef AIF_CHECKSUM_X86
+
+// Description: Fold per-lane totals back into the running sums.
+// Params:
+// - sum1, sum2: running sums, updated in place
+// - a: per-position byte totals over all chunks
+// - p: per-position totals of `a` taken before each chunk
+// - width: chunk width in bytes (number of lanes)
+// - chunks: number of chunks processed
+// Returns: void.
+static void checksum_fold(
+    uint32_t *sum1,
+    uint32_t *sum2,
+    const uint16_t *a,
+    const uint16_t *p,
+    size_t width,
+    size_t chunks
+) {
+    uint32_t block_sum1 = 0;
+    uint32_t block_sum2 = 0;
+    for (size_t i = 0; i < width; i++) {
+        block_sum1 += a[i];
+        block_sum2 += (uint32_t)width * p[i] + (uint32_t)(width - i) * a[i];
+    }
+
+    *sum2 += (uint32_t)(chunks * width) * *sum1 + block_sum2;
+    *sum1 += block_sum1;
+}
+
+#ifdef __SSE2__
+// Description: SSE2 checksum kernel over 16-byte chunks.
+// Params:
+// - sum1, sum2: running sums, updated in place
+// - buf: bytes to add
+// - n: number of bytes
+// Returns: void.
+static void checksum_block_sse2(
+    uint32_t *sum1,
+    uint32_t *sum2,
+    const uint8_t *buf,
+    size_t n
+) {
+    size_t chunks = n / 16;
+    __m128i zero = _mm_setzero_si128();
+    __m128i a_lo = zero, a_hi = zero;
+    __m128i p_lo = zero, p_hi = zero;
+
+    for (size_t k = 0; k < chunks; k++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + k * 16));
+        p_lo = _mm_add_epi16(p_lo, a_lo);
+        p_hi = _mm_add_epi16(p_hi, a_hi);
+        a_lo = _mm_add_epi16(a_lo, _mm_unpacklo_epi8(v, zero));
+        a_hi = _mm_add_epi16(a_hi, _mm_unpackhi_epi8(v, zero));
+    }
+
+    uint16_t a[16], p[16];
+    _mm_storeu_si128((__m128i *)a, a_lo);
+    _mm_storeu_si128((__m128i *)(a + 8), a_hi);
+    _mm_storeu_si128((__m128i *)p, p_lo);
+    _mm_storeu_si128((__m128i *)(p + 8), p_hi);
+    checksum_fold(sum1, sum2, a, p, 16, chunks);
+
+    checksum_block_scalar(sum1, sum2, buf + chunks * 16, n - chunks * 16);
+}
+#endif
+
+// Description: AVX2 checksum kernel over 32-byte chunks.
+// Params:
+// - sum1, sum2: running sums, updated in place
+// - buf: bytes to add
+// - n: number of bytes
+// Returns: void.
+__attribute__((target("avx2")))
+static void checksum_block_avx2(
+    uint32_t *sum1,
+    uint32_t *sum2,
+    const uint8_t *buf,
+    size_t n
+) {
+    size_t chunks = n / 32;
+    __m256i a_lo = _mm256_setzero_si256(), a_hi = _mm256_setzero_si256();
+    __m256i p_lo = _mm256_setzero_si256(), p_hi = _mm256_setzero_si256();
+
+    for (size_t k = 0; k < chunks; k++) {
+        const uint8_t *chunk = buf + k * 32;
+        __m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)chunk));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(chunk + 16)));
+        p_lo = _mm256_add_epi16(p_lo, a_lo);
+        p_hi = _mm256_add_epi16(p_hi, a_hi);
+        a_lo = _mm256_add_epi16(a_lo, lo);
+        a_hi = _mm256_add_epi16(a_hi, hi);
+    }
+
+    uint16_t a[32], p[32];
+    _mm256_storeu_si256((__m256i *)a, a_lo);
+    _mm256_storeu_si256((__m256i *)(a + 16), a_hi);
+    _mm256_storeu_si256((__m256i *)p, p_lo);
+    _mm256_storeu_si256((__m256i *)(p + 16), p_hi);
+    checksum_fold(sum1, sum2, a, p, 32, chunks);
+
+    checksum_block_scalar(sum1, sum2, buf + chunks * 32, n - chunks * 32);
+}
+
+#endif
+
+// Description: Add a block of bytes to the running sums using the fastest
+//              kernel the CPU supports.
+// Params:
+// - sum1, sum2: running sums, updated in place
+// - buf: bytes to add
+// - n: number of bytes
+// Returns: void.
+static void checksum_block(
+    uint32_t *sum1,
+    uint32_t *sum2,
+    const uint8_t *buf,
+    size_t n
+) {
+    if (n < SIMD_MIN_BYTES) {
+        checksum_block_scalar(sum1, sum2, buf, n);
+        return;
+    }
+
+#ifdef AIF_CHECKSUM_X86
+    if (__builtin_cpu_supports("avx2")) {
+        checksum_block_avx2(sum1, sum2, buf, n);
+        return;
+    }
+#ifdef __SSE2__
+    checksum_block_sse2(sum1, sum2, buf, n);
+    return;
+#endif
+#endif
+
+    checksum_block_scalar(sum1, sum2, buf, n);
+}
+
+// Description: Reset a checksum to the start of a file.
+// Params:
+// - c: checksum state
+// Returns: void.
+void aif_checksum_init(struct aif_checksum *c) {
+    aif_checksum_init_at(c, 0);
+}
+
+// Description: Reset a checksum to cover bytes starting part way into a file.
+// Params:
+// - c: checksum state
+// - offset: file offset of the first byte that will be fed
+// Returns: void.
+void aif_checksum_init_at(struct aif_checksum *c, uint64_t offset) {
+    c->sum1 = 0;
+    c->sum2 = 0;
+    c->start = offset;
+    c->pos = offset;
+}
+
+// Description: Feed the next bytes of the file into the checksum.
+// Params:
+// - c: checksum state
+// - buf: bytes to add
+// - n: number of bytes in buf
+// Returns: void.
+void aif_checksum_update(struct aif_checksum *c, const uint8_t *buf, size_t n) {
+    size_t done = 0;
+
+    // Treat stored checksum bytes as 0
+    while (done < n && c->pos + done < AIF_CHECKSUM_OFFSET + AIF_CHECKSUM_SIZE) {
+        uint64_t pos = c->pos + done;
+        if (pos < AIF_CHECKSUM_OFFSET) {
+            size_t len = AIF_CHECKSUM_OFFSET - pos;
+            if (len > n - done) {
+                len = n - done;
+            }
+            checksum_block_scalar(&c->sum1, &c->sum2, buf + done, len);
+            done += len;
+        } else {
+            c->sum2 += c->sum1;
+            done++;
+        }
+    }
+
+    checksum_block(&c->sum1, &c->sum2, buf + done, n - done);
+    c->pos += n;
+}
+
+// Description: Read out the checksum of everything fed so far.
+// Params:
+// - c: checksum state
+// Returns: checksum value (sum2 in the high byte, sum1 in the low byte).
+uint16_t aif_checksum_value(const struct aif_checksum *c) {
+    return (uint16_t)(((c->sum2 & 0xFF) << 8) | (c->sum1 & 0xFF));
+}
+
+// Description: Merge the checksum of the bytes directly following `a`.
+// Params:
+// - a: checksum of the earlier bytes; updated to cover both ranges
+// - b: checksum started with aif_checksum_init_at(b, a->pos)
+// Returns: void.
+void aif_checksum_combine(struct aif_checksum *a, const struct aif_checksum *b) {
+    uint64_t b_len = b->pos - b->start;
+    a->sum2 += (uint32_t)b_len * a->sum1 + b->sum2;
+    a->sum1 += b->sum1;
+    a->pos = b->pos;
+}
+
+// Description: Pool task; checksum one chunk of the file.
+// Params:
+// - ctx: checksum_job
+// - index: chunk number
+// Returns: void.
+static void checksum_chunk_task(void *ctx, size_t index) {
+    struct checksum_job *job = ctx;
+
+    uint64_t start = (uint64_t)index * AIF_CHECKSUM_CHUNK_SIZE;
+    uint64_t end = start + AIF_CHECKSUM_CHUNK_SIZE;
+    if (end > job->size) {
+        end = job->size;
+    }
+
+    aif_checksum_init_at(&job->chunks[index], start);
+    aif_checksum_update(&job->chunks[index], job->data + start, end - start);
+}
+
+// Description: Checksum a whole file, splitting large files into chunks
+//              that are summed on a thread pool and merged in order.
+// Params:
+// - data: file contents
+// - size: number of bytes in data
+// - n_threads: threads to use for large files
+// Returns: checksum value.
+uint16_t aif_checksum_buffer(const uint8_t *data, uint64_t size, int n_threads) {
+    struct aif_checksum total;
+    aif_checksum_init(&total);
+
+    size_t n_chunks = (size + AIF_CHECKSUM_CHUNK_SIZE - 1) / AIF_CHECKSUM_CHUNK_SIZE;
+    struct aif_checksum *chunks = NULL;
+    struct aif_pool *pool = NULL;
+    if (size >= AIF_CHECKSUM_PARALLEL_MIN && n_threads > 1) {
+        chunks = malloc(sizeof(*chunks) * n_chunks);
+        pool = aif_pool_create(n_threads);
+    }
+
+    if (chunks == NULL || pool == NULL) {
+        free(chunks);
+        aif_pool_destroy(pool);
+        aif_checksum_update(&total, data, size);
+        return aif_checksum_value(&total);
+    }
+
+    struct checksum_job job = { data, size, chunks };
+    aif_pool_run(pool, n_chunks, checksum_chunk_task, &job);
+    aif_pool_destroy(pool);
+
+    for (size_t i = 0; i < n_chunks; i++) {
+        aif_checksum_combine(&total, &chunks[i]);
+    }
+
+    free(chunks);
+    return aif_checksum_value(&total);
+}
@@ -0,0 +1,33 @@
+#ifndef AIF_CHECKSUM_H
+#define AIF_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Running state of the AIF checksum. Both sums are only ever needed
+// modulo 256, so they are left to wrap and reduced when read out.
+struct aif_checksum {
+    uint32_t sum1;
+    uint32_t sum2;
+    uint64_t start;
+    uint64_t pos;
+};
+
+// Files at least this large are checksummed in parallel chunks
+#define AIF_CHECKSUM_PARALLEL_MIN (64 << 20)
+#define AIF_CHECKSUM_CHUNK_SIZE (16 << 20)
+
+// Resets a checksum to the start of a file
+void aif_checksum_init(struct aif_checksum *c);
+// Resets a checksum to cover bytes starting at the given file offset
+void aif_checksum_init_at(struct aif_checksum *c, uint64_t offset);
+// Feeds the next n bytes of the file into the checksum
+void aif_checksum_update(struct aif_checksum *c, const uint8_t *buf, size_t n);
+// Appends the sums of the bytes that directly follow `a` (covered by `b`)
+void aif_checksum_combine(struct aif_checksum *a, const struct aif_checksum *b);
+// Returns the checksum of all bytes fed so far
+uint16_t aif_checksum_value(const struct aif_checksum *c);
+// Checksums a whole file held in memory, using n_threads for large files
+uint16_t aif_checksum_buffer(const uint8_t *data, uint64_t size, int n_threads);
+
+#endif
@@ -0,0 +1,245 @@
+// Description: Pixel format conversion kernels.
+//
+//              RGB8 to GRAY8 luma is (r*299 + g*587 + b*114) / 1000. The
+//              vector kernels form the weighted sum with a multiply-add
+//              on 16-bit lanes, then divide without a division:
+//                  n / 1000 == ((n >> 3) * 33555) >> 22
+//              for every n up to 255 * 1000. n >> 3 fits in 16 bits, so
+//              the multiply is a 16-bit high multiply followed by a shift
+//              of 6.
+//
+//              GRAY8 to RGB8 repeats each byte three times; the vector
+//              kernels do this with byte shuffles of 16 gray bytes into
+//              three 16-byte thirds of the output.
+
+#include "aif-convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AIF_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+// Fixed-point division by 1000, see above
+#define LUMA_PRE_SHIFT 3
+#define LUMA_MULTIPLIER 33555
+#define LUMA_POST_SHIFT 6
+
+// Source byte of each output byte in the three thirds of a 16-pixel
+// GRAY8 to RGB8 expansion
+#define TRIPLE_0 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5
+#define TRIPLE_1 5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10
+#define TRIPLE_2 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15
+
+// Description: Scalar RGB8 to GRAY8 conversion.
+// Params:
+// - in: RGB8 pixels
+// - out: GRAY8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+static void rgb_to_gray_scalar(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+    for (size_t i = 0, j = 0; j < n_pixels; i += 3, j++) {
+        uint8_t r = in[i];
+        uint8_t g = in[i + 1];
+        uint8_t b = in[i + 2];
+        out[j] = (uint8_t)((r * 299 + g * 587 + b * 114) / 1000);
+    }
+}
+
+// Description: Scalar GRAY8 to RGB8 expansion.
+// Params:
+// - in: GRAY8 pixels
+// - out: RGB8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+static void gray_to_rgb_scalar(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+    for (size_t i = 0, j = 0; i < n_pixels; i++, j += 3) {
+        uint8_t g = in[i];
+        out[j]     = g;
+        out[j + 1] = g;
+        out[j + 2] = g;
+    }
+}
+
+#ifdef AIF_CONVERT_X86
+
+// Description: RGB8 to GRAY8 conversion of 16 pixels at a time with SSSE3.
+// Params:
+// - in: RGB8 pixels
+// - out: GRAY8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+__attribute__((target("ssse3")))
+static void rgb_to_gray_ssse3(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+    // Spread two pixels of a 12-byte group into 16-bit lanes (r, g, b, 0)
+    const __m128i spread_lo = _mm_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1,
+                                            3, -1, 4, -1, 5, -1, -1, -1);
+    const __m128i spread_hi = _mm_setr_epi8(6, -1, 7, -1, 8, -1, -1, -1,
+                                            9, -1, 10, -1, 11, -1, -1, -1);
+    const __m128i weights = _mm_setr_epi16(299, 587, 114, 0, 299, 587, 114, 0);
+    const __m128i multiplier = _mm_set1_epi16(LUMA_MULTIPLIER);
+
+    // Each group reads 16 bytes for 12 bytes of pixels, so stop while the
+    // last group still has input after it
+    size_t i = 0;
+    for (; i + 16 + 2 <= n_pixels; i += 16) {
+        __m128i quads[4];
+        for (int q = 0; q < 4; q++) {
+            __m128i px = _mm_loadu_si128((const __m128i *)(in + (i + q * 4) * 3));
+            // madd leaves (r*299 + g*587, b*114) per pixel; hadd joins them
+            __m128i lo = _mm_madd_epi16(_mm_shuffle_epi8(px, spread_lo), weights);
+            __m128i hi = _mm_madd_epi16(_mm_shuffle_epi8(px, spread_hi), weights);
+            quads[q] = _mm_srli_epi32(_mm_hadd_epi32(lo, hi), LUMA_PRE_SHIFT);
+        }
+        // Sums are below 2^15 after the shift, so signed packing is exact
+        __m128i a = _mm_packs_epi32(quads[0], quads[1]);
+        __m128i b = _mm_packs_epi32(quads[2], quads[3]);
+        a = _mm_srli_epi16(_mm_mulhi_epu16(a, multiplier), LUMA_POST_SHIFT);
+        b = _mm_srli_epi16(_mm_mulhi_epu16(b, multiplier), LUMA_POST_SHIFT);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(a, b));
+    }
+    rgb_to_gray_scalar(in + i * 3, out + i, n_pixels - i);
+}
+
+// Description: RGB8 to GRAY8 conversion of 32 pixels at a time with AVX2.
+// Params:
+// - in: RGB8 pixels
+// - out: GRAY8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+__attribute__((target("avx2")))
+static void rgb_to_gray_avx2(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+    const __m256i spread_lo = _mm256_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1,
+                                               3, -1, 4, -1, 5, -1, -1, -1,
+                                               0, -1, 1, -1, 2, -1, -1, -1,
+                                               3, -1, 4, -1, 5, -1, -1, -1);
+    const __m256i spread_hi = _mm256_setr_epi8(6, -1, 7, -1, 8, -1, -1, -1,
+                                               9, -1, 10, -1, 11, -1, -1, -1,
+                                               6, -1, 7, -1, 8, -1, -1, -1,
+                                               9, -1, 10, -1, 11, -1, -1, -1);
+    const __m256i weights = _mm256_setr_epi16(299, 587, 114, 0, 299, 587, 114, 0,
+                                              299, 587, 114, 0, 299, 587, 114, 0);
+    const __m256i multiplier = _mm256_set1_epi16(LUMA_MULTIPLIER);
+    // packs works within 128-bit lanes; this puts the groups of four
+    // pixels back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t i = 0;
+    for (; i + 32 + 2 <= n_pixels; i += 32) {
+        // Each vector holds eight pixels, four per 128-bit lane
+        __m256i octs[4];
+        for (int q = 0; q < 4; q++) {
+            const uint8_t *p = in + (i + q * 8) * 3;
+            __m256i px = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+            __m256i lo = _mm256_madd_epi16(_mm256_shuffle_epi8(px, spread_lo), weights);
+            __m256i hi = _mm256_madd_epi16(_mm256_shuffle_epi8(px, spread_hi), weights);
+            octs[q] = _mm256_srli_epi32(_mm256_hadd_epi32(lo, hi), LUMA_PRE_SHIFT);
+        }
+        __m256i a = _mm256_packs_epi32(octs[0], octs[1]);
+        __m256i b = _mm256_packs_epi32(octs[2], octs[3]);
+        a = _mm256_srli_epi16(_mm256_mulhi_epu16(a, multiplier), LUMA_POST_SHIFT);
+        b = _mm256_srli_epi16(_mm256_mulhi_epu16(b, multiplier), LUMA_POST_SHIFT);
+        __m256i gray = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+        _mm256_storeu_si256((__m256i *)(out + i), gray);
+    }
+    rgb_to_gray_scalar(in + i * 3, out + i, n_pixels - i);
+}
+
+// Description: GRAY8 to RGB8 expansion of 16 pixels at a time with SSSE3.
+// Params:
+// - in: GRAY8 pixels
+// - out: RGB8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+__attribute__((target("ssse3")))
+static void gray_to_rgb_ssse3(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+    const __m128i third_0 = _mm_setr_epi8(TRIPLE_0);
+    const __m128i third_1 = _mm_setr_epi8(TRIPLE_1);
+    const __m128i third_2 = _mm_setr_epi8(TRIPLE_2);
+
+    size_t i = 0;
+    for (; i + 16 <= n_pixels; i += 16) {
+        __m128i gray = _mm_loadu_si128((const __m128i *)(in + i));
+        uint8_t *p = out + i * 3;
+        _mm_storeu_si128((__m128i *)p, _mm_shuffle_epi8(gray, third_0));
+        _mm_storeu_si128((__m128i *)(p + 16), _mm_shuffle_epi8(gray, third_1));
+        _mm_storeu_si128((__m128i *)(p + 32), _mm_shuffle_epi8(gray, third_2));
+    }
+    gray_to_rgb_scalar(in + i, out + i * 3, n_pixels - i);
+}
+
+// Description: GRAY8 to RGB8 expansion of 32 pixels at a time with AVX2.
+// Params:
+// - in: GRAY8 pixels
+// - out: RGB8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+__attribute__((target("avx2")))
+static void gray_to_rgb_avx2(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+    // vpshufb stays within 128-bit lanes, so each 32-byte output takes its
+    // two thirds from whichever half of the input they need
+    const __m256i thirds_01 = _mm256_setr_epi8(TRIPLE_0, TRIPLE_1);
+    const __m256i thirds_20 = _mm256_setr_epi8(TRIPLE_2, TRIPLE_0);
+    const __m256i thirds_12 = _mm256_setr_epi8(TRIPLE_1, TRIPLE_2);
+
+    size_t i = 0;
+    for (; i + 32 <= n_pixels; i += 32) {
+        // Broadcasting straight from memory keeps the lane copies off the
+        // shuffle port
+        __m256i gray = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(in + i)));
+        __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(in + i + 16)));
+        uint8_t *p = out + i * 3;
+        _mm256_storeu_si256((__m256i *)p, _mm256_shuffle_epi8(low, thirds_01));
+        _mm256_storeu_si256((__m256i *)(p + 32), _mm256_shuffle_epi8(gray, thirds_20));
+        _mm256_storeu_si256((__m256i *)(p + 64), _mm256_shuffle_epi8(high, thirds_12));
+    }
+    gray_to_rgb_scalar(in + i, out + i * 3, n_pixels - i);
+}
+
+#endif
+
+// Description: Convert RGB8 pixels to GRAY8 with the fastest kernel the CPU
+//              supports.
+// Params:
+// - in: RGB8 pixels
+// - out: GRAY8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+void aif_rgb_to_gray(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+#ifdef AIF_CONVERT_X86
+    if (__builtin_cpu_supports("avx2")) {
+        rgb_to_gray_avx2(in, out, n_pixels);
+        return;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        rgb_to_gray_ssse3(in, out, n_pixels);
+        return;
+    }
+#endif
+
+    rgb_to_gray_scalar(in, out, n_pixels);
+}
+
+// Description: Expand GRAY8 pixels to RGB8 with the fastest kernel the CPU
+//              supports.
+// Params:
+// - in: GRAY8 pixels
+// - out: RGB8 pixels
+// - n_pixels: number of pixels
+// Returns: void.
+void aif_gray_to_rgb(const uint8_t *in, uint8_t *out, size_t n_pixels) {
+#ifdef AIF_CONVERT_X86
+    if (__builtin_cpu_supports("avx2")) {
+        gray_to_rgb_avx2(in, out, n_pixels);
+        return;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        gray_to_rgb_ssse3(in, out, n_pixels);
+        return;
+    }
+#endif
+
+    gray_to_rgb_scalar(in, out, n_pixels);
+}
@@ -0,0 +1,12 @@
+#ifndef AIF_CONVERT_H
+#define AIF_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Converts n_pixels RGB8 pixels to GRAY8 luma, (r*299 + g*587 + b*114) / 1000
+void aif_rgb_to_gray(const uint8_t *in, uint8_t *out, size_t n_pixels);
+// Expands n_pixels GRAY8 pixels to RGB8 by repeating each value three times
+void aif_gray_to_rgb(const uint8_t *in, uint8_t *out, size_t n_pixels);
+
+#endif
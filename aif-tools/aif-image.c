@@ -0,0 +1,1370 @@
+// Description: Library interface to AIF files. An aif_image handle reads
+//              or writes the rows of one file, and aif_image_transform
+//              streams an open image through pixel operations into a new
+//              file. Failures are returned as AIF_ERR_* codes rather than
+//              reported, so one process can work through any number of
+//              images; the command-line tool is a thin layer on top.
+
+#include "aif.h"
+#include "aif-brighten.h"
+#include "aif-cache.h"
+#include "aif-checksum.h"
+#include "aif-convert.h"
+#include "aif-image.h"
+#include "aif-index.h"
+#include "aif-io.h"
+#include "aif-lut.h"
+#include "aif-pool.h"
+#include "aif-rle.h"
+#include "aif-stream.h"
+#include "aif-tile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// RGB images whose sampled pixels use at most this many distinct colours
+// are brightened through a colour cache
+#define LOW_COLOUR_SAMPLES (AIF_RGB_SAMPLE_PIXELS / 4)
+
+// Context of brighten_rgb_cached_row
+struct brighten_rgb_cached {
+    int amount;
+    struct aif_rgb_cache *cache;
+};
+
+// Pixels per chunk when a row passes through more than one operation;
+// the chunks in between stay in the L1 cache from one operation to the next
+#define CHAIN_CHUNK_PIXELS 1024
+
+// One operation of a chain and the state it works from
+struct chain_op {
+    aif_row_op fn;
+    void *ctx;
+    size_t out_bpp;
+    uint8_t gray_lut[AIF_LUT_SIZE];
+    struct brighten_rgb_cached cached;
+};
+
+// Context of chain_row
+struct op_chain {
+    int n_ops;
+    size_t in_bpp;
+    struct chain_op ops[AIF_MAX_OPS];
+};
+
+// Context of batch_file_task
+struct aif_batch {
+    struct aif_batch_file *files;
+    const struct aif_transform *t;
+};
+
+// An input or output path of a batch, named by the directory it is in and
+// its name there, so different spellings of one path compare equal
+struct batch_path {
+    dev_t dir_dev;
+    ino_t dir_ino;
+    const char *name;
+    size_t file;
+    int is_output;
+};
+
+struct aif_image {
+    int writing;
+    struct aif_reader in;
+    struct aif_writer out;
+    // Copy of the output path, which the writer needs until it is closed
+    char *filename;
+
+    int format;
+    int compression;
+    uint32_t width;
+    uint32_t height;
+    size_t bpp;
+
+    // Rows read or written so far, and where the next input row starts
+    uint32_t next_row;
+    size_t pos;
+    // Row index trailer of an RLE input, if it has a valid one
+    int has_index;
+    struct aif_row_index_view index_view;
+    // Tiles of a tiled input
+    struct aif_tile_view tiles;
+
+    // Scratch for one compressed row when writing RLE, or one compressed
+    // tile when writing tiles
+    uint8_t *comp_row;
+    // Rows of a tiled image waiting to be written, one tile high
+    uint8_t *band;
+    uint32_t band_rows;
+    struct aif_tile_table out_tiles;
+    // Row index being collected for the output, if asked for
+    int indexing;
+    struct aif_row_index out_index;
+};
+
+// Description: Check whether header bytes match the AIF magic.
+// Params:
+// - h: pointer to start of header
+// Returns: TRUE if valid, otherwise FALSE.
+static int header_magic_valid(const uint8_t *h) {
+    return h[0] == 0x41 && h[1] == 0x49 && h[2] == 0x46 && h[3] == 0x00;
+}
+
+// Description: Validate pixel format byte.
+// Params:
+// - format: pixel format code
+// Returns: TRUE if recognised, otherwise FALSE.
+static int header_format_valid(int format) {
+    return format == AIF_FMT_RGB8 || format == AIF_FMT_GRAY8;
+}
+
+// Description: Validate compression byte.
+// Params:
+// - compression: compression code
+// Returns: TRUE if recognised, otherwise FALSE.
+static int header_compression_valid(int compression) {
+    return compression == AIF_COMPRESSION_NONE
+        || compression == AIF_COMPRESSION_RLE
+        || compression == AIF_COMPRESSION_TILED
+        || compression == AIF_COMPRESSION_RLE_WIDE;
+}
+
+// Description: Validate dimension field.
+// Params:
+// - n: dimension value
+// Returns: TRUE if > 0, otherwise FALSE.
+static int header_dim_valid(uint32_t n) {
+    return n > 0;
+}
+
+// Description: Store a 32-bit value little-endian.
+// Params:
+// - buf: destination
+// - value: value to store
+// Returns: void.
+static void put_le_u32(uint8_t *buf, uint32_t value) {
+    buf[0] = value & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+    buf[2] = (value >> 16) & 0xFF;
+    buf[3] = (value >> 24) & 0xFF;
+}
+
+// Description: Bytes per pixel of a (valid) pixel format.
+// Params:
+// - format: pixel format code
+// Returns: 3 for RGB8, 1 for GRAY8.
+static size_t format_bpp(int format) {
+    if (format == AIF_FMT_RGB8) {
+        return 3;
+    }
+    return 1;
+}
+
+// Description: Size of rows of pixels, checked for overflow, as a bogus
+//              header can claim far more pixels than a size_t can count.
+// Params:
+// - width: pixels in each row
+// - n_rows: number of rows
+// - bpp: bytes per pixel
+// - bytes: set to width * n_rows * bpp if it fits
+// Returns: TRUE if it fits in a size_t, otherwise FALSE.
+static int pixel_bytes(uint32_t width, uint64_t n_rows, size_t bpp, size_t *bytes) {
+    size_t row_bytes;
+    return !__builtin_mul_overflow((size_t)width, bpp, &row_bytes)
+           && !__builtin_mul_overflow(row_bytes, n_rows, bytes);
+}
+
+// Description: Check that the row and band buffers of an image can be
+//              sized. A band is at most a tile high, and a compressed row
+//              with its prefix at most 4 + width * (bpp + 2) bytes; only
+//              a 32-bit size_t can fall short of that.
+// Params:
+// - width: width in pixels
+// - bpp: bytes per pixel
+// Returns: TRUE if the buffers fit in a size_t, otherwise FALSE.
+static int buffers_fit(uint32_t width, size_t bpp) {
+    size_t bytes;
+    return pixel_bytes(width, AIF_TILE_SIZE, bpp + 6, &bytes);
+}
+
+// Description: Read the header of a file.
+// Params:
+// - filename: path to input AIF
+// - info: filled in with the header fields and their validity
+// Returns: AIF_OK, AIF_ERR_OPEN or AIF_ERR_EOF.
+int aif_read_info(const char *filename, struct aif_info *info) {
+    struct aif_reader file;
+    if (!aif_reader_open(&file, filename)) {
+        return AIF_ERR_OPEN;
+    }
+    if (file.size < AIF_HEADER_SIZE) {
+        aif_reader_close(&file);
+        return AIF_ERR_EOF;
+    }
+    const uint8_t *header = file.data;
+
+    info->file_size = file.size;
+    info->magic_valid = header_magic_valid(header);
+    info->stored_checksum = read_le_u16(&header[AIF_CHECKSUM_OFFSET]);
+    info->checksum = aif_checksum_buffer(file.data, file.size, aif_cpu_count());
+    info->format = header[AIF_PXL_FMT_OFFSET];
+    info->format_valid = header_format_valid(info->format);
+    info->compression = header[AIF_COMPRESSION_OFFSET];
+    info->width = read_le_u32(&header[AIF_WIDTH_OFFSET]);
+    info->width_valid = header_dim_valid(info->width);
+    info->height = read_le_u32(&header[AIF_HEIGHT_OFFSET]);
+    info->height_valid = header_dim_valid(info->height);
+
+    struct aif_row_index_view view;
+    info->row_index_interval = 0;
+    if (AIF_RLE_ROWS(info->compression) && info->height_valid
+        && aif_row_index_find(file.data + AIF_HEADER_SIZE,
+                              file.size - AIF_HEADER_SIZE, info->height, &view)) {
+        info->row_index_interval = view.interval;
+    }
+
+    struct aif_tile_view tiles;
+    info->tile_width = 0;
+    info->tile_height = 0;
+    if (info->compression == AIF_COMPRESSION_TILED
+        && info->width_valid && info->height_valid
+        && aif_tile_find(file.data + AIF_HEADER_SIZE, file.size - AIF_HEADER_SIZE,
+                         info->width, info->height, &tiles)) {
+        info->tile_width = tiles.tile_width;
+        info->tile_height = tiles.tile_height;
+    }
+
+    aif_reader_close(&file);
+    return AIF_OK;
+}
+
+// Description: Open an AIF file for reading and validate its header.
+// Params:
+// - img: set to the new handle on success, otherwise NULL
+// - filename: path to input AIF
+// Returns: AIF_OK, AIF_ERR_OPEN, AIF_ERR_EOF, AIF_ERR_INVALID,
+//          AIF_ERR_CORRUPT (a tiled image without a valid tile table) or
+//          AIF_ERR_NO_MEMORY.
+int aif_image_open(struct aif_image **img, const char *filename) {
+    *img = NULL;
+    struct aif_image *image = calloc(1, sizeof(*image));
+    if (image == NULL) {
+        return AIF_ERR_NO_MEMORY;
+    }
+    if (!aif_reader_open(&image->in, filename)) {
+        free(image);
+        return AIF_ERR_OPEN;
+    }
+
+    int status = AIF_OK;
+    const uint8_t *header = image->in.data;
+    if (image->in.size < AIF_HEADER_SIZE) {
+        status = AIF_ERR_EOF;
+    } else {
+        image->format = header[AIF_PXL_FMT_OFFSET];
+        image->compression = header[AIF_COMPRESSION_OFFSET];
+        image->width = read_le_u32(&header[AIF_WIDTH_OFFSET]);
+        image->height = read_le_u32(&header[AIF_HEIGHT_OFFSET]);
+        if (!header_magic_valid(header)
+            || !header_format_valid(image->format)
+            || !header_dim_valid(image->width)
+            || !header_dim_valid(image->height)
+            || !header_compression_valid(image->compression)) {
+            status = AIF_ERR_INVALID;
+        } else if (image->compression == AIF_COMPRESSION_TILED
+                   && !aif_tile_find(image->in.data + AIF_HEADER_SIZE,
+                                     image->in.size - AIF_HEADER_SIZE,
+                                     image->width, image->height, &image->tiles)) {
+            status = AIF_ERR_CORRUPT;
+        }
+    }
+    if (status != AIF_OK) {
+        aif_reader_close(&image->in);
+        free(image);
+        return status;
+    }
+
+    image->bpp = format_bpp(image->format);
+    if (!buffers_fit(image->width, image->bpp)) {
+        aif_reader_close(&image->in);
+        free(image);
+        return AIF_ERR_NO_MEMORY;
+    }
+    if (AIF_RLE_ROWS(image->compression)) {
+        image->has_index = aif_row_index_find(image->in.data + AIF_HEADER_SIZE,
+                                              image->in.size - AIF_HEADER_SIZE,
+                                              image->height, &image->index_view);
+    }
+    *img = image;
+    return AIF_OK;
+}
+
+// Description: Free a handle and its buffers (but not its file).
+// Params:
+// - img: handle to free
+// Returns: void.
+static void image_free(struct aif_image *img) {
+    aif_tile_table_free(&img->out_tiles);
+    free(img->band);
+    free(img->comp_row);
+    free(img->filename);
+    free(img);
+}
+
+// Description: Create an AIF file to be filled in with aif_image_write_rows.
+// Params:
+// - img: set to the new handle on success, otherwise NULL
+// - filename: path to output AIF
+// - format: pixel format (AIF_FMT_*)
+// - compression: compression (AIF_COMPRESSION_*); AIF_COMPRESSION_RLE
+//                becomes AIF_COMPRESSION_RLE_WIDE for rows too wide for
+//                2-byte lengths
+// - width: width in pixels (> 0)
+// - height: height in pixels (> 0)
+// Returns: AIF_OK, AIF_ERR_ARGUMENT, AIF_ERR_OPEN_OUTPUT, AIF_ERR_WRITE or
+//          AIF_ERR_NO_MEMORY.
+int aif_image_create(
+    struct aif_image **img,
+    const char *filename,
+    int format,
+    int compression,
+    uint32_t width,
+    uint32_t height
+) {
+    *img = NULL;
+    if (!header_format_valid(format) || !header_compression_valid(compression)
+        || !header_dim_valid(width) || !header_dim_valid(height)) {
+        return AIF_ERR_ARGUMENT;
+    }
+    if (compression == AIF_COMPRESSION_RLE) {
+        compression = aif_rle_compression_for(width, format_bpp(format));
+    }
+    if (!buffers_fit(width, format_bpp(format))) {
+        return AIF_ERR_NO_MEMORY;
+    }
+
+    struct aif_image *image = calloc(1, sizeof(*image));
+    if (image == NULL) {
+        return AIF_ERR_NO_MEMORY;
+    }
+    image->writing = TRUE;
+    image->format = format;
+    image->compression = compression;
+    image->width = width;
+    image->height = height;
+    image->bpp = format_bpp(format);
+    image->filename = strdup(filename);
+    int ok = image->filename != NULL;
+    if (AIF_RLE_ROWS(compression)) {
+        image->comp_row = malloc(AIF_RLE_MAX_ROW(width, image->bpp));
+        ok = ok && image->comp_row != NULL;
+    } else if (compression == AIF_COMPRESSION_TILED) {
+        // Rows are held until there are enough for a row of tiles
+        ok = ok && aif_tile_table_init(&image->out_tiles, width, height);
+        uint32_t band_rows = image->out_tiles.tile_height;
+        if (band_rows > height) {
+            band_rows = height;
+        }
+        image->band = malloc((size_t)band_rows * width * image->bpp);
+        image->comp_row = malloc(AIF_TILE_MAX_BYTES(image->out_tiles.tile_width,
+                                                    band_rows, image->bpp));
+        ok = ok && image->band != NULL && image->comp_row != NULL;
+    }
+    if (!ok) {
+        image_free(image);
+        return AIF_ERR_NO_MEMORY;
+    }
+
+    if (!aif_writer_open(&image->out, image->filename)) {
+        image_free(image);
+        return AIF_ERR_OPEN_OUTPUT;
+    }
+
+    // The checksum bytes are left zero until the file is finished
+    uint8_t header[AIF_HEADER_SIZE] = { 0 };
+    memcpy(header, AIF_MAGIC, AIF_MAGIC_SIZE);
+    header[AIF_PXL_FMT_OFFSET] = format;
+    header[AIF_COMPRESSION_OFFSET] = compression;
+    put_le_u32(&header[AIF_WIDTH_OFFSET], width);
+    put_le_u32(&header[AIF_HEIGHT_OFFSET], height);
+    put_le_u32(&header[AIF_PXL_OFFSET_OFFSET], AIF_HEADER_SIZE);
+    *img = image;
+    if (!aif_writer_write(&image->out, header, AIF_HEADER_SIZE)
+        || (compression == AIF_COMPRESSION_TILED
+            && !aif_tile_table_start(&image->out, &image->out_tiles))) {
+        aif_image_close(image);
+        *img = NULL;
+        return AIF_ERR_WRITE;
+    }
+    return AIF_OK;
+}
+
+// Description: Header fields of an open image.
+// Params:
+// - img: open image
+// Returns: the field's value.
+int aif_image_format(const struct aif_image *img) {
+    return img->format;
+}
+
+int aif_image_compression(const struct aif_image *img) {
+    return img->compression;
+}
+
+uint32_t aif_image_width(const struct aif_image *img) {
+    return img->width;
+}
+
+uint32_t aif_image_height(const struct aif_image *img) {
+    return img->height;
+}
+
+size_t aif_image_bpp(const struct aif_image *img) {
+    return img->bpp;
+}
+
+// Description: Move an image opened for reading to a row. Uncompressed
+//              rows and tiles are found directly. Compressed rows are
+//              found by walking length prefixes, starting from the
+//              nearest earlier row in the row index if the file has one
+//              and its entry agrees with the prefixes, or else from the
+//              current row (or the first, when seeking backwards).
+// Params:
+// - img: image opened with aif_image_open
+// - row: row to move to (< height)
+// Returns: AIF_OK, AIF_ERR_EOF if the data ends before the row, or
+//          AIF_ERR_ARGUMENT if there is no such row.
+int aif_image_seek_row(struct aif_image *img, uint32_t row) {
+    if (img->writing || row >= img->height) {
+        return AIF_ERR_ARGUMENT;
+    }
+
+    if (img->compression == AIF_COMPRESSION_NONE) {
+        size_t pos;
+        if (!pixel_bytes(img->width, row, img->bpp, &pos)
+            || pos > img->in.size - AIF_HEADER_SIZE) {
+            return AIF_ERR_EOF;
+        }
+        img->pos = pos;
+        img->next_row = row;
+        return AIF_OK;
+    }
+    if (img->compression == AIF_COMPRESSION_TILED) {
+        img->next_row = row;
+        return AIF_OK;
+    }
+
+    const uint8_t *data = img->in.data + AIF_HEADER_SIZE;
+    size_t size = img->in.size - AIF_HEADER_SIZE;
+    size_t prefix_size = AIF_RLE_PREFIX_SIZE(img->compression);
+    uint32_t from = 0;
+    size_t pos = 0;
+    if (img->has_index) {
+        // The entry is only checked when the current row is further back;
+        // one that disagrees with the length prefixes is passed over
+        uint32_t entry = row / img->index_view.interval;
+        uint32_t entry_row = entry * img->index_view.interval;
+        if ((img->next_row > row || img->next_row < entry_row)
+            && aif_row_index_lookup(&img->index_view, data, prefix_size, entry, &pos)) {
+            from = entry_row;
+        }
+    }
+    if (img->next_row <= row && img->next_row >= from) {
+        from = img->next_row;
+        pos = img->pos;
+    }
+
+    uint32_t n_skip = row - from;
+    if (aif_scan_compressed_rows(data, size, &pos, prefix_size, n_skip,
+                                 NULL, NULL) < n_skip) {
+        return AIF_ERR_EOF;
+    }
+    img->pos = pos;
+    img->next_row = row;
+    return AIF_OK;
+}
+
+// Description: Decode the next rows of an image opened for reading.
+// Params:
+// - img: image opened with aif_image_open
+// - pixels: destination for n_rows rows of width * bpp bytes
+// - n_rows: number of rows wanted
+// Returns: AIF_OK, AIF_ERR_EOF, AIF_ERR_CORRUPT, or AIF_ERR_ARGUMENT if
+//          the image has fewer rows left.
+int aif_image_read_rows(struct aif_image *img, uint8_t *pixels, uint32_t n_rows) {
+    if (img->writing || n_rows > img->height - img->next_row) {
+        return AIF_ERR_ARGUMENT;
+    }
+
+    const uint8_t *data = img->in.data + AIF_HEADER_SIZE;
+    size_t size = img->in.size - AIF_HEADER_SIZE;
+    size_t row_bytes = (size_t)img->width * img->bpp;
+    if (img->compression == AIF_COMPRESSION_TILED) {
+        if (n_rows == 0) {
+            return AIF_OK;
+        }
+        int status = aif_tile_decode_region(&img->tiles, img->bpp, 0, img->next_row,
+                                            img->width, n_rows, pixels, row_bytes);
+        if (status == AIF_OK) {
+            img->next_row += n_rows;
+        }
+        return status;
+    }
+    for (uint32_t r = 0; r < n_rows; r++) {
+        uint8_t *row = pixels + (size_t)r * row_bytes;
+        if (AIF_RLE_ROWS(img->compression)) {
+            int status = aif_read_compressed_row(data, size, &img->pos,
+                                                 AIF_RLE_PREFIX_SIZE(img->compression),
+                                                 row, row_bytes, img->bpp);
+            if (status != AIF_OK) {
+                return status;
+            }
+        } else {
+            if (size - img->pos < row_bytes) {
+                return AIF_ERR_EOF;
+            }
+            memcpy(row, data + img->pos, row_bytes);
+            img->pos += row_bytes;
+        }
+        img->next_row++;
+    }
+    return AIF_OK;
+}
+
+// Description: Have an RLE image being written end with a row index
+//              trailer when it is closed.
+// Params:
+// - img: image created with aif_image_create, before any rows are written
+// Returns: AIF_OK, AIF_ERR_NO_MEMORY, or AIF_ERR_ARGUMENT if the image is
+//          not an RLE image being written or already has rows.
+int aif_image_set_row_index(struct aif_image *img) {
+    if (!img->writing || !AIF_RLE_ROWS(img->compression)
+        || img->next_row > 0 || img->indexing) {
+        return AIF_ERR_ARGUMENT;
+    }
+    if (!aif_row_index_init(&img->out_index, img->height)) {
+        return AIF_ERR_NO_MEMORY;
+    }
+    img->indexing = TRUE;
+    return AIF_OK;
+}
+
+// Description: Decode a rectangle of an image opened for reading. Only
+//              its rows are read, found as by aif_image_seek_row, and
+//              compressed blocks left of it are skipped over. Tiled
+//              images decode just the tiles under the rectangle.
+// Params:
+// - img: image opened with aif_image_open
+// - x: first column
+// - y: first row
+// - width: columns wanted
+// - height: rows wanted
+// - pixels: receives height rows of width * bpp bytes
+// Returns: AIF_OK, AIF_ERR_EOF, AIF_ERR_CORRUPT, or AIF_ERR_REGION if
+//          the rectangle is empty or not inside the image.
+int aif_image_read_region(
+    struct aif_image *img,
+    uint32_t x,
+    uint32_t y,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *pixels
+) {
+    if (img->writing) {
+        return AIF_ERR_ARGUMENT;
+    }
+    if (x >= img->width || width == 0 || width > img->width - x
+        || y >= img->height || height == 0 || height > img->height - y) {
+        return AIF_ERR_REGION;
+    }
+    if (img->compression == AIF_COMPRESSION_TILED) {
+        int status = aif_tile_decode_region(&img->tiles, img->bpp, x, y, width,
+                                            height, pixels, (size_t)width * img->bpp);
+        if (status == AIF_OK) {
+            img->next_row = y + height;
+        }
+        return status;
+    }
+    int status = aif_image_seek_row(img, y);
+    if (status != AIF_OK) {
+        return status;
+    }
+
+    const uint8_t *data = img->in.data + AIF_HEADER_SIZE;
+    size_t size = img->in.size - AIF_HEADER_SIZE;
+    size_t in_row_bytes = (size_t)img->width * img->bpp;
+    size_t out_row_bytes = (size_t)width * img->bpp;
+    for (uint32_t r = 0; r < height; r++) {
+        uint8_t *row = pixels + (size_t)r * out_row_bytes;
+        if (AIF_RLE_ROWS(img->compression)) {
+            size_t offset;
+            uint32_t length;
+            if (aif_scan_compressed_rows(data, size, &img->pos,
+                                         AIF_RLE_PREFIX_SIZE(img->compression),
+                                         1, &offset, &length) < 1) {
+                return AIF_ERR_EOF;
+            }
+            if (!aif_rle_decode_span(data + offset, length, img->width,
+                                     img->bpp, x, width, row)) {
+                return AIF_ERR_CORRUPT;
+            }
+        } else {
+            if (size - img->pos < in_row_bytes) {
+                return AIF_ERR_EOF;
+            }
+            memcpy(row, data + img->pos + (size_t)x * img->bpp, out_row_bytes);
+            img->pos += in_row_bytes;
+        }
+        img->next_row++;
+    }
+    return AIF_OK;
+}
+
+// Description: Add rows to a tiled image being written. Rows are held
+//              in the band until it is a tile high (or the image is
+//              complete), then its tiles are encoded and written.
+// Params:
+// - img: tiled image created with aif_image_create
+// - pixels: n_rows rows of width * bpp bytes
+// - n_rows: number of rows to add (no more than are missing)
+// Returns: TRUE on success, FALSE on write failure.
+static int write_tiled_rows(struct aif_image *img, const uint8_t *pixels, uint32_t n_rows) {
+    size_t row_bytes = (size_t)img->width * img->bpp;
+    uint32_t tile_width = img->out_tiles.tile_width;
+    uint32_t tiles_x = (img->width - 1) / tile_width + 1;
+
+    for (uint32_t r = 0; r < n_rows; r++) {
+        memcpy(img->band + (size_t)img->band_rows * row_bytes,
+               pixels + (size_t)r * row_bytes, row_bytes);
+        img->band_rows++;
+        if (img->band_rows < img->out_tiles.tile_height
+            && img->next_row + r + 1 < img->height) {
+            continue;
+        }
+
+        for (uint32_t tx = 0; tx < tiles_x; tx++) {
+            uint32_t left = tx * tile_width;
+            uint32_t width = img->width - left;
+            if (width > tile_width) {
+                width = tile_width;
+            }
+            size_t len = aif_tile_encode_rows(img->band + (size_t)left * img->bpp,
+                                              row_bytes, width, img->band_rows,
+                                              img->bpp, img->comp_row);
+            if (!aif_tile_write(&img->out, &img->out_tiles, img->comp_row, len)) {
+                return FALSE;
+            }
+        }
+        img->band_rows = 0;
+    }
+    return TRUE;
+}
+
+// Description: Encode and append rows to an image opened for writing.
+// Params:
+// - img: image created with aif_image_create
+// - pixels: n_rows rows of width * bpp bytes
+// - n_rows: number of rows to append
+// Returns: AIF_OK, AIF_ERR_WRITE, or AIF_ERR_ARGUMENT if that would be
+//          more rows than the image has.
+int aif_image_write_rows(struct aif_image *img, const uint8_t *pixels, uint32_t n_rows) {
+    if (!img->writing || n_rows > img->height - img->next_row) {
+        return AIF_ERR_ARGUMENT;
+    }
+
+    int ok;
+    if (AIF_RLE_ROWS(img->compression)) {
+        struct aif_row_index *index = NULL;
+        if (img->indexing) {
+            index = &img->out_index;
+        }
+        ok = aif_write_compressed_rows(&img->out, pixels, img->width, n_rows,
+                                       img->bpp, AIF_RLE_PREFIX_SIZE(img->compression),
+                                       img->comp_row, index);
+    } else if (img->compression == AIF_COMPRESSION_TILED) {
+        ok = write_tiled_rows(img, pixels, n_rows);
+    } else {
+        ok = aif_writer_write(&img->out, pixels,
+                              (size_t)n_rows * img->width * img->bpp);
+    }
+    if (!ok) {
+        return AIF_ERR_WRITE;
+    }
+    img->next_row += n_rows;
+    return AIF_OK;
+}
+
+// Description: Build the table mapping each gray value to its brightened
+//              value, so the per-pixel division is done 256 times per
+//              image rather than once per pixel.
+// Params:
+// - lut: 256-entry table to fill
+// - amount: brighten/darken percentage (-100..100)
+// Returns: void.
+static void build_brighten_gray_lut(uint8_t *lut, int amount) {
+    for (int i = 0; i < AIF_LUT_SIZE; i++) {
+        int16_t val = i;
+        val = val + (val * amount / 100);
+        if (val > 255) val = 255;
+        if (val < 0) val = 0;
+        lut[i] = (uint8_t)val;
+    }
+}
+
+// Description: Row operation; brighten 8-bit grayscale pixels.
+// Params:
+// - ctx: brighten table built by build_brighten_gray_lut
+// - in: source pixels
+// - out: destination pixels
+// - width: pixels in the row
+// Returns: void.
+static void brighten_gray_row(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width) {
+    aif_lut_apply(ctx, in, out, width);
+}
+
+// Description: Row operation; brighten 8-bit RGB pixels.
+// Params:
+// - ctx: pointer to the brighten amount (int)
+// - in: source pixels
+// - out: destination pixels
+// - width: pixels in the row
+// Returns: void.
+static void brighten_rgb_row(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width) {
+    int amount = *(const int *)ctx;
+    size_t done = aif_brighten_rgb_simd(in, out, width, amount);
+    for (size_t i = done * 3; i < (size_t)width * 3; i += 3) {
+        uint32_t colour = (in[i] << 16)
+                       | (in[i + 1] << 8)
+                       | (in[i + 2]);
+        colour = brighten_rgb(colour, amount);
+        out[i]     = (colour >> 16) & 0xFF;
+        out[i + 1] = (colour >> 8) & 0xFF;
+        out[i + 2] = colour & 0xFF;
+    }
+}
+
+// Description: Row operation; brighten 8-bit RGB pixels, computing each
+//              distinct colour only once. Rows fall back to
+//              brighten_rgb_row once the cache is full, which only happens
+//              for images with many more colours than sampling suggested.
+// Params:
+// - ctx: struct brighten_rgb_cached
+// - in: source pixels
+// - out: destination pixels
+// - width: pixels in the row
+// Returns: void.
+static void brighten_rgb_cached_row(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width) {
+    struct brighten_rgb_cached *cached = ctx;
+    if (aif_rgb_cache_full(cached->cache)) {
+        brighten_rgb_row(&cached->amount, in, out, width);
+        return;
+    }
+
+    // Neighbouring pixels are usually the same colour, so the last result
+    // is checked before the cache
+    uint32_t last_colour = 0;
+    uint32_t last_result = brighten_rgb(0, cached->amount);
+    for (size_t i = 0; i < (size_t)width * 3; i += 3) {
+        uint32_t colour = (in[i] << 16)
+                       | (in[i + 1] << 8)
+                       | (in[i + 2]);
+        if (colour != last_colour) {
+            if (!aif_rgb_cache_get(cached->cache, colour, &last_result)) {
+                last_result = brighten_rgb(colour, cached->amount);
+                aif_rgb_cache_put(cached->cache, colour, last_result);
+            }
+            last_colour = colour;
+        }
+        out[i]     = (last_result >> 16) & 0xFF;
+        out[i + 1] = (last_result >> 8) & 0xFF;
+        out[i + 2] = last_result & 0xFF;
+    }
+}
+
+// Description: Row operation; convert 8-bit RGB pixels to 8-bit grayscale.
+// Params:
+// - ctx: unused
+// - in: source RGB pixels
+// - out: destination gray pixels
+// - width: pixels in the row
+// Returns: void.
+static void rgb_to_gray_row(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width) {
+    (void)ctx;
+    aif_rgb_to_gray(in, out, width);
+}
+
+// Description: Row operation; convert 8-bit grayscale pixels to 8-bit RGB.
+// Params:
+// - ctx: unused
+// - in: source gray pixels
+// - out: destination RGB pixels
+// - width: pixels in the row
+// Returns: void.
+static void gray_to_rgb_row(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width) {
+    (void)ctx;
+    aif_gray_to_rgb(in, out, width);
+}
+
+// Description: Row operation; apply each operation of a chain in turn.
+//              Every operation works pixel by pixel, so the row is taken
+//              in chunks, each passed through the whole chain before the
+//              next.
+// Params:
+// - ctx: struct op_chain
+// - in: source pixels
+// - out: destination pixels
+// - width: pixels in the row
+// Returns: void.
+static void chain_row(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width) {
+    const struct op_chain *chain = ctx;
+    uint8_t chunks[2][CHAIN_CHUNK_PIXELS * 3];
+    int last = chain->n_ops - 1;
+    size_t out_bpp = chain->ops[last].out_bpp;
+
+    for (uint32_t done = 0; done < width; done += CHAIN_CHUNK_PIXELS) {
+        uint32_t n = width - done;
+        if (n > CHAIN_CHUNK_PIXELS) {
+            n = CHAIN_CHUNK_PIXELS;
+        }
+
+        const uint8_t *src = in + (size_t)done * chain->in_bpp;
+        for (int k = 0; k <= last; k++) {
+            uint8_t *dst = chunks[k % 2];
+            if (k == last) {
+                dst = out + (size_t)done * out_bpp;
+            }
+            chain->ops[k].fn(chain->ops[k].ctx, src, dst, n);
+            src = dst;
+        }
+    }
+}
+
+// Description: Set up an operation that brightens pixels.
+// Params:
+// - img: input image
+// - format: pixel format the operation receives
+// - op: operation to fill in; its cached.amount is already set, and a
+//       colour cache may be created that the caller must destroy
+// Returns: void.
+static void chain_brighten(
+    const struct aif_image *img,
+    int format,
+    struct chain_op *op
+) {
+    op->out_bpp = format_bpp(format);
+    if (format == AIF_FMT_GRAY8) {
+        build_brighten_gray_lut(op->gray_lut, op->cached.amount);
+        op->fn = brighten_gray_row;
+        op->ctx = op->gray_lut;
+        return;
+    }
+    op->fn = brighten_rgb_row;
+    op->ctx = &op->cached.amount;
+
+    // Without a vector kernel, low-colour images are faster through the
+    // colour cache. Operations never add colours, so sampling the input
+    // gives an upper bound for later operations too; GRAY8 input has at
+    // most 256. Compressed input cannot be sampled without decoding it,
+    // so the cache is tried and gives up by itself if it fills.
+    int low_colour = !aif_brighten_rgb_has_simd();
+    if (low_colour && img->format == AIF_FMT_RGB8
+        && img->compression == AIF_COMPRESSION_NONE) {
+        size_t n_pixels = (img->in.size - AIF_HEADER_SIZE) / img->bpp;
+        if (n_pixels > (size_t)img->width * img->height) {
+            n_pixels = (size_t)img->width * img->height;
+        }
+        low_colour = aif_rgb_sample_colours(img->in.data + AIF_HEADER_SIZE, n_pixels)
+                     <= LOW_COLOUR_SAMPLES;
+    }
+    if (low_colour) {
+        op->cached.cache = aif_rgb_cache_create();
+    }
+    if (op->cached.cache != NULL) {
+        op->fn = brighten_rgb_cached_row;
+        op->ctx = &op->cached;
+    }
+}
+
+// Description: Set up the row operations of a transform, leaving out any
+//              that do nothing.
+// Params:
+// - chain: zeroed chain to fill in
+// - img: input image
+// - t: validated transform
+// Returns: void; colour caches created here are freed by chain_destroy.
+static void chain_build(
+    struct op_chain *chain,
+    const struct aif_image *img,
+    const struct aif_transform *t
+) {
+    int format = img->format;
+    chain->in_bpp = img->bpp;
+
+    for (int i = 0; i < t->n_ops; i++) {
+        const struct aif_op *op = &t->ops[i];
+        struct chain_op *c = &chain->ops[chain->n_ops];
+
+        if (op->type == AIF_OP_BRIGHTEN) {
+            c->cached.amount = op->amount;
+            chain_brighten(img, format, c);
+            chain->n_ops++;
+        } else if (op->type == AIF_OP_CONVERT && op->format != format) {
+            if (op->format == AIF_FMT_GRAY8) {
+                c->fn = rgb_to_gray_row;
+            } else {
+                c->fn = gray_to_rgb_row;
+            }
+            format = op->format;
+            c->out_bpp = format_bpp(format);
+            chain->n_ops++;
+        }
+    }
+}
+
+// Description: Free the colour caches of a chain.
+// Params:
+// - chain: chain set up by chain_build
+// Returns: void.
+static void chain_destroy(struct op_chain *chain) {
+    for (int i = 0; i < chain->n_ops; i++) {
+        aif_rgb_cache_destroy(chain->ops[i].cached.cache);
+    }
+}
+
+// Description: Write a new image by streaming every row of an open image
+//              through a pixel operation.
+// Params:
+// - img: image opened with aif_image_open; rows already read with
+//        aif_image_read_rows do not matter
+// - out_file: output AIF path; may be the input file itself
+// - t: operations, output compression and thread count
+// Returns: AIF_OK or an AIF_ERR_* code; nothing is left at out_file if
+//          the stream fails.
+int aif_image_transform(
+    struct aif_image *img,
+    const char *out_file,
+    const struct aif_transform *t
+) {
+    int compression = t->compression;
+    if (compression == AIF_COMPRESSION_KEEP) {
+        compression = img->compression;
+    }
+    if (img->writing || !header_compression_valid(compression)
+        || t->n_threads < 1) {
+        return AIF_ERR_ARGUMENT;
+    }
+
+    // Region of the input to keep
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = img->width;
+    uint32_t height = img->height;
+    if (t->crop_width > 0) {
+        x = t->crop_x;
+        y = t->crop_y;
+        width = t->crop_width;
+        height = t->crop_height;
+        if (x >= img->width || width > img->width - x
+            || y >= img->height || height == 0 || height > img->height - y) {
+            return AIF_ERR_REGION;
+        }
+    }
+
+    uint8_t header[AIF_HEADER_SIZE];
+    memcpy(header, img->in.data, AIF_HEADER_SIZE);
+    header[AIF_COMPRESSION_OFFSET] = compression;
+    put_le_u32(&header[AIF_WIDTH_OFFSET], width);
+    put_le_u32(&header[AIF_HEIGHT_OFFSET], height);
+
+    // Every operation maps pixels on their own, so RLE to RLE passes
+    // work on runs
+    struct aif_stream stream = {
+        .in_compression = img->compression,
+        .in_bpp = img->bpp,
+        .in_width = img->width,
+        .in_x = x,
+        .width = width,
+        .height = height,
+        .op = NULL,
+        .op_per_pixel = TRUE,
+        .out_bpp = img->bpp,
+        .out_compression = compression,
+        .n_threads = t->n_threads,
+    };
+
+    // Check the operations and find the output format
+    if (t->n_ops < 0 || t->n_ops > AIF_MAX_OPS) {
+        return AIF_ERR_ARGUMENT;
+    }
+    int format = img->format;
+    for (int i = 0; i < t->n_ops; i++) {
+        const struct aif_op *op = &t->ops[i];
+        if (op->type == AIF_OP_BRIGHTEN) {
+            if (op->amount < -100 || op->amount > 100) {
+                return AIF_ERR_ARGUMENT;
+            }
+        } else if (op->type == AIF_OP_CONVERT) {
+            if (!header_format_valid(op->format)) {
+                return AIF_ERR_ARGUMENT;
+            }
+            format = op->format;
+        } else if (op->type != AIF_OP_NONE) {
+            return AIF_ERR_ARGUMENT;
+        }
+    }
+    stream.out_bpp = format_bpp(format);
+    header[AIF_PXL_FMT_OFFSET] = format;
+
+    // Rows too wide for 2-byte lengths get 4-byte ones
+    if (compression == AIF_COMPRESSION_RLE) {
+        compression = aif_rle_compression_for(width, stream.out_bpp);
+        stream.out_compression = compression;
+        header[AIF_COMPRESSION_OFFSET] = compression;
+    }
+
+    // Uncompressed input must be complete (up to the last row used)
+    // before anything is written
+    if (img->compression == AIF_COMPRESSION_NONE) {
+        size_t bytes;
+        if (!pixel_bytes(img->width, (uint64_t)y + height, img->bpp, &bytes)
+            || img->in.size - AIF_HEADER_SIZE < bytes) {
+            return AIF_ERR_EOF;
+        }
+    }
+
+    // Rows above a crop are skipped, not decoded (tiles are found from
+    // their table instead)
+    size_t start = 0;
+    if (y > 0 && img->compression != AIF_COMPRESSION_TILED) {
+        int status = aif_image_seek_row(img, y);
+        if (status != AIF_OK) {
+            return status;
+        }
+        start = img->pos;
+    }
+
+    // Write output file, checksumming as it goes. Its name is only taken
+    // over once it is complete, so the input stays mapped even when it is
+    // the file being replaced.
+    struct aif_writer out;
+    if (!aif_writer_open(&out, out_file)) {
+        return AIF_ERR_OPEN_OUTPUT;
+    }
+    if (!aif_writer_write(&out, header, AIF_HEADER_SIZE)) {
+        aif_writer_abort(&out);
+        return AIF_ERR_WRITE;
+    }
+
+    // A single operation is run on its own, a longer chain chunk by chunk
+    struct op_chain chain;
+    memset(&chain, 0, sizeof(chain));
+    chain_build(&chain, img, t);
+    if (chain.n_ops == 1) {
+        stream.op = chain.ops[0].fn;
+        stream.op_ctx = chain.ops[0].ctx;
+    } else if (chain.n_ops > 1) {
+        stream.op = chain_row;
+        stream.op_ctx = &chain;
+    }
+
+    stream.in_tiles = &img->tiles;
+    stream.in_y = y;
+    stream.in_data = img->in.data + AIF_HEADER_SIZE + start;
+    stream.in_size = img->in.size - AIF_HEADER_SIZE - start;
+    stream.out = &out;
+
+    // The row index is only worth having on compressed output
+    struct aif_row_index index = { 0 };
+    int status = AIF_OK;
+    if (t->row_index && AIF_RLE_ROWS(compression)) {
+        if (aif_row_index_init(&index, height)) {
+            stream.out_index = &index;
+        } else {
+            status = AIF_ERR_NO_MEMORY;
+        }
+    }
+
+    if (status == AIF_OK) {
+        status = aif_stream_image(&stream);
+    }
+    if (status == AIF_OK && stream.out_index != NULL
+        && !aif_row_index_write(&out, &index)) {
+        status = AIF_ERR_WRITE;
+    }
+    chain_destroy(&chain);
+    aif_row_index_free(&index);
+    if (status != AIF_OK) {
+        aif_writer_abort(&out);
+        return status;
+    }
+
+    // Patch checksum into header and close
+    if (!aif_writer_finish(&out)) {
+        return AIF_ERR_WRITE;
+    }
+    return AIF_OK;
+}
+
+// Description: Identify a path of a batch by its directory.
+// Params:
+// - p: filled in
+// - path: input or output path
+// - file: file of the batch the path belongs to
+// - is_output: TRUE for the output path, FALSE for the input
+// Returns: TRUE on success, FALSE if out of memory.
+static int batch_path_init(struct batch_path *p, const char *path, size_t file, int is_output) {
+    p->file = file;
+    p->is_output = is_output;
+
+    const char *slash = strrchr(path, '/');
+    const char *dir_start = path;
+    size_t dir_len = 1;
+    if (slash == NULL) {
+        p->name = path;
+        dir_start = ".";
+    } else {
+        p->name = slash + 1;
+        if (slash > path) {
+            dir_len = slash - path;
+        }
+    }
+    char *dir = malloc(dir_len + 1);
+    if (dir == NULL) {
+        return FALSE;
+    }
+    memcpy(dir, dir_start, dir_len);
+    dir[dir_len] = '\0';
+
+    // A directory that does not exist fails the file later on; until then
+    // the path is compared as written
+    struct stat st;
+    if (stat(dir, &st) == 0) {
+        p->dir_dev = st.st_dev;
+        p->dir_ino = st.st_ino;
+    } else {
+        p->dir_dev = 0;
+        p->dir_ino = 0;
+        p->name = path;
+    }
+    free(dir);
+    return TRUE;
+}
+
+// Description: qsort comparison of batch paths.
+// Params:
+// - a: struct batch_path
+// - b: struct batch_path
+// Returns: negative, zero or positive as a sorts before, with or after b.
+static int batch_path_compare(const void *a, const void *b) {
+    const struct batch_path *pa = a;
+    const struct batch_path *pb = b;
+    if (pa->dir_dev != pb->dir_dev) {
+        return pa->dir_dev < pb->dir_dev ? -1 : 1;
+    }
+    if (pa->dir_ino != pb->dir_ino) {
+        return pa->dir_ino < pb->dir_ino ? -1 : 1;
+    }
+    return strcmp(pa->name, pb->name);
+}
+
+// Description: Fail the files of a batch whose output would clash with
+//              another file: two files writing one output, or a file
+//              writing over the input of another, which may be read before
+//              or after it is replaced. A file writing over its own input
+//              is fine, as the input stays mapped until the output is
+//              renamed into place.
+// Params:
+// - files: files of the batch; clashing ones get AIF_ERR_CLASH
+// - n_files: number of files
+// Returns: TRUE on success, FALSE if out of memory.
+static int batch_find_clashes(struct aif_batch_file *files, size_t n_files) {
+    struct batch_path *paths = malloc(2 * n_files * sizeof(*paths));
+    if (paths == NULL) {
+        return FALSE;
+    }
+    for (size_t i = 0; i < n_files; i++) {
+        if (!batch_path_init(&paths[2 * i], files[i].in_file, i, FALSE)
+            || !batch_path_init(&paths[2 * i + 1], files[i].out_file, i, TRUE)) {
+            free(paths);
+            return FALSE;
+        }
+    }
+    qsort(paths, 2 * n_files, sizeof(*paths), batch_path_compare);
+
+    // Each run of equal paths is one file on disk
+    size_t start = 0;
+    while (start < 2 * n_files) {
+        size_t end = start + 1;
+        size_t n_outputs = paths[start].is_output;
+        while (end < 2 * n_files && batch_path_compare(&paths[start], &paths[end]) == 0) {
+            n_outputs += paths[end].is_output;
+            end++;
+        }
+        for (size_t i = start; i < end; i++) {
+            if (!paths[i].is_output) {
+                continue;
+            }
+            int clash = n_outputs > 1;
+            for (size_t j = start; j < end && !clash; j++) {
+                clash = !paths[j].is_output && paths[j].file != paths[i].file;
+            }
+            if (clash) {
+                files[paths[i].file].status = AIF_ERR_CLASH;
+            }
+        }
+        start = end;
+    }
+
+    free(paths);
+    return TRUE;
+}
+
+// Description: Task of aif_transform_batch; transform one file.
+// Params:
+// - ctx: struct aif_batch
+// - index: file of the batch
+// Returns: void; the result is left in the file's status.
+static void batch_file_task(void *ctx, size_t index) {
+    struct aif_batch *batch = ctx;
+    struct aif_batch_file *file = &batch->files[index];
+    if (file->status != AIF_OK) {
+        return;
+    }
+
+    struct aif_image *img;
+    file->status = aif_image_open(&img, file->in_file);
+    if (file->status == AIF_OK) {
+        file->status = aif_image_transform(img, file->out_file, batch->t);
+        aif_image_close(img);
+    }
+}
+
+// Description: Transform many files with the same operation. Files are
+//              handed out to the threads one at a time, so a few large
+//              images do not hold up the rest, and a file that fails
+//              does not stop the others. Files whose outputs clash are
+//              failed before any work starts.
+// Params:
+// - files: input and output paths; each status is filled in
+// - n_files: number of files
+// - t: operation applied to every file; its n_threads is used within
+//      each file
+// - n_threads: number of files worked on at once
+// Returns: number of files whose status is not AIF_OK.
+size_t aif_transform_batch(
+    struct aif_batch_file *files,
+    size_t n_files,
+    const struct aif_transform *t,
+    int n_threads
+) {
+    struct aif_batch batch = { files, t };
+
+    for (size_t i = 0; i < n_files; i++) {
+        files[i].status = AIF_OK;
+    }
+    if (!batch_find_clashes(files, n_files)) {
+        for (size_t i = 0; i < n_files; i++) {
+            files[i].status = AIF_ERR_NO_MEMORY;
+        }
+        return n_files;
+    }
+
+    // Without a pool (one thread, or no memory for one) files are done in turn
+    struct aif_pool *pool = NULL;
+    if (n_threads > 1 && n_files > 1) {
+        if ((size_t)n_threads > n_files) {
+            n_threads = n_files;
+        }
+        pool = aif_pool_create(n_threads);
+    }
+    if (pool != NULL) {
+        aif_pool_run(pool, n_files, batch_file_task, &batch);
+    } else {
+        for (size_t i = 0; i < n_files; i++) {
+            batch_file_task(&batch, i);
+        }
+    }
+    aif_pool_destroy(pool);
+
+    size_t n_failed = 0;
+    for (size_t i = 0; i < n_files; i++) {
+        if (files[i].status != AIF_OK) {
+            n_failed++;
+        }
+    }
+    return n_failed;
+}
+
+// Description: Close an image. Written images are finished, storing their
+//              checksum, unless rows are missing, in which case the
+//              partial file is removed.
+// Params:
+// - img: image to close (NULL is ignored)
+// Returns: AIF_OK, AIF_ERR_WRITE, or AIF_ERR_ARGUMENT if a written image
+//          was missing rows.
+int aif_image_close(struct aif_image *img) {
+    if (img == NULL) {
+        return AIF_OK;
+    }
+
+    int status = AIF_OK;
+    if (!img->writing) {
+        aif_reader_close(&img->in);
+    } else if (img->next_row < img->height) {
+        aif_writer_abort(&img->out);
+        status = AIF_ERR_ARGUMENT;
+    } else if (img->indexing && !aif_row_index_write(&img->out, &img->out_index)) {
+        aif_writer_abort(&img->out);
+        status = AIF_ERR_WRITE;
+    } else if (img->compression == AIF_COMPRESSION_TILED
+               && !aif_tile_table_write(&img->out, &img->out_tiles)) {
+        aif_writer_abort(&img->out);
+        status = AIF_ERR_WRITE;
+    } else if (!aif_writer_finish(&img->out)) {
+        status = AIF_ERR_WRITE;
+    }
+    if (img->indexing) {
+        aif_row_index_free(&img->out_index);
+    }
+
+    image_free(img);
+    return status;
+}
+
+// Description: Describe an error code in the words of the command-line
+//              tool.
+// Params:
+// - status: AIF_OK or an AIF_ERR_* code
+// Returns: constant message string.
+const char *aif_error_message(int status) {
+    switch (status) {
+    case AIF_OK:
+        return "Success";
+    case AIF_ERR_EOF:
+        return "Unexpected EOF";
+    case AIF_ERR_CORRUPT:
+        return "Invalid compressed data";
+    case AIF_ERR_WRITE:
+        return "Failed to write to output file";
+    case AIF_ERR_NO_MEMORY:
+        return "Out of memory";
+    case AIF_ERR_OPEN:
+        return "Failed to open file: No such file or directory";
+    case AIF_ERR_INVALID:
+        return "Not a valid AIF file";
+    case AIF_ERR_OPEN_OUTPUT:
+        return "Failed to open output file: No such file or directory";
+    case AIF_ERR_ARGUMENT:
+        return "Invalid argument";
+    case AIF_ERR_REGION:
+        return "Crop region is not inside the image";
+    case AIF_ERR_CLASH:
+        return "Output file clashes with another file of the batch";
+    default:
+        return "Unknown error";
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef AIF_IMAGE_H
+#define AIF_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aif.h"
+
+// Pixel operations aif_image_transform can apply on the way to the output
+#define AIF_OP_NONE (0)
+#define AIF_OP_BRIGHTEN (1)
+#define AIF_OP_CONVERT (2)
+
+// Output compression of aif_transform meaning "same as the input"
+#define AIF_COMPRESSION_KEEP (-1)
+
+// Most operations one aif_transform can chain
+#define AIF_MAX_OPS (8)
+
+// Header fields of an AIF file and their validity, as printed by
+// `aif-tools info`
+struct aif_info {
+    size_t file_size;
+    int magic_valid;
+    uint16_t stored_checksum;
+    uint16_t checksum;
+    uint8_t format;
+    int format_valid;
+    uint8_t compression;
+    uint32_t width;
+    int width_valid;
+    uint32_t height;
+    int height_valid;
+    // Rows per entry of the row index trailer, or 0 if there is none
+    uint32_t row_index_interval;
+    // Tile size of a tiled image with a valid tile table, otherwise 0
+    uint32_t tile_width;
+    uint32_t tile_height;
+};
+
+// One pixel operation of a transform
+struct aif_op {
+    // AIF_OP_*
+    int type;
+    // Percentage for AIF_OP_BRIGHTEN (-100..100)
+    int amount;
+    // Pixel format produced by AIF_OP_CONVERT
+    int format;
+};
+
+// One pass from an open image to a new file. The operations are applied
+// to each pixel in turn between decoding and encoding, so a chain of
+// them costs one read and one write of the image.
+struct aif_transform {
+    int n_ops;
+    struct aif_op ops[AIF_MAX_OPS];
+    // Compression of the output (AIF_COMPRESSION_* or AIF_COMPRESSION_KEEP);
+    // RLE rows too wide for 2-byte lengths are written as
+    // AIF_COMPRESSION_RLE_WIDE
+    int compression;
+    // Set to append a row index trailer (aif-index.h) to RLE output
+    int row_index;
+    // Region of the input to keep; a zero crop_width keeps the whole image
+    uint32_t crop_x;
+    uint32_t crop_y;
+    uint32_t crop_width;
+    uint32_t crop_height;
+    // Threads used to decode, transform and compress rows
+    int n_threads;
+};
+
+// One file of a batch and the AIF_OK or AIF_ERR_* code it ended with
+struct aif_batch_file {
+    const char *in_file;
+    const char *out_file;
+    int status;
+};
+
+// An AIF file opened for reading rows (aif_image_open) or for writing
+// them (aif_image_create). No function of the library exits or prints;
+// they all return AIF_OK or an AIF_ERR_* code.
+struct aif_image;
+
+// The library's interface; libaif.so is built with -fvisibility=hidden,
+// so only what is marked with this is exported from it
+#define AIF_API __attribute__((visibility("default")))
+
+// Reads the header of filename and checksums the whole file
+AIF_API int aif_read_info(const char *filename, struct aif_info *info);
+
+// Opens and validates filename for reading
+AIF_API int aif_image_open(struct aif_image **img, const char *filename);
+// Creates filename for writing an image of the given shape
+AIF_API int aif_image_create(
+    struct aif_image **img,
+    const char *filename,
+    int format,
+    int compression,
+    uint32_t width,
+    uint32_t height
+);
+// Header fields of an open image
+AIF_API int aif_image_format(const struct aif_image *img);
+AIF_API int aif_image_compression(const struct aif_image *img);
+AIF_API uint32_t aif_image_width(const struct aif_image *img);
+AIF_API uint32_t aif_image_height(const struct aif_image *img);
+// Bytes per pixel of an open image
+AIF_API size_t aif_image_bpp(const struct aif_image *img);
+// Moves to row, so that it is the next one aif_image_read_rows decodes
+AIF_API int aif_image_seek_row(struct aif_image *img, uint32_t row);
+// Decodes the next n_rows rows into pixels (width * bpp bytes per row)
+AIF_API int aif_image_read_rows(struct aif_image *img, uint8_t *pixels, uint32_t n_rows);
+// Decodes the rectangle of width x height pixels at (x, y) into pixels,
+// reading only the rows and blocks it covers
+AIF_API int aif_image_read_region(
+    struct aif_image *img,
+    uint32_t x,
+    uint32_t y,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *pixels
+);
+// Makes an RLE image being written end with a row index trailer; must be
+// called before any rows are written
+AIF_API int aif_image_set_row_index(struct aif_image *img);
+// Encodes and appends n_rows rows of pixels
+AIF_API int aif_image_write_rows(struct aif_image *img, const uint8_t *pixels, uint32_t n_rows);
+// Streams the whole of an image opened for reading into out_file
+AIF_API int aif_image_transform(
+    struct aif_image *img,
+    const char *out_file,
+    const struct aif_transform *t
+);
+// Transforms each in_file of a batch into its out_file, working on up to
+// n_threads files at once; files whose outputs clash with another file
+// fail with AIF_ERR_CLASH. Returns the number of files that failed
+AIF_API size_t aif_transform_batch(
+    struct aif_batch_file *files,
+    size_t n_files,
+    const struct aif_transform *t,
+    int n_threads
+);
+// Finishes (or, if rows are missing, removes) a written image and frees
+// the handle
+AIF_API int aif_image_close(struct aif_image *img);
+
+// Describes an AIF_ERR_* code
+AIF_API const char *aif_error_message(int status);
+
+#endif
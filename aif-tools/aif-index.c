@@ -0,0 +1,207 @@
+// Description: Row index trailer for RLE images. Offsets are collected as
+//              rows are written and appended after the last row, and a
+//              reader checks the trailer thoroughly before trusting it, so
+//              a damaged or coincidental one is simply ignored.
+
+#include "aif-index.h"
+#include "aif-io.h"
+#include "aif-rle.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Description: Store a 32-bit value little-endian.
+// Params:
+// - buf: destination
+// - value: value to store
+// Returns: void.
+static void put_le_u32(uint8_t *buf, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+// Description: Store a 64-bit value little-endian.
+// Params:
+// - buf: destination
+// - value: value to store
+// Returns: void.
+static void put_le_u64(uint8_t *buf, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+// Description: Number of entries indexing an image.
+// Params:
+// - height: rows in the image (> 0)
+// - interval: rows per entry (> 0)
+// Returns: entry count.
+static uint32_t index_entries(uint32_t height, uint32_t interval) {
+    return (height - 1) / interval + 1;
+}
+
+// Description: Prepare to collect the row offsets of an image.
+// Params:
+// - index: index to set up
+// - height: rows in the image (> 0)
+// Returns: TRUE on success, FALSE if out of memory.
+int aif_row_index_init(struct aif_row_index *index, uint32_t height) {
+    index->interval = AIF_ROW_INDEX_INTERVAL;
+    index->n_entries = index_entries(height, index->interval);
+    index->n_rows = 0;
+    index->pos = 0;
+    index->offsets = malloc((size_t)index->n_entries * sizeof(*index->offsets));
+    return index->offsets != NULL;
+}
+
+// Description: Record the next row of the image.
+// Params:
+// - index: index being collected
+// - row_size: bytes of the row, length prefix included
+// Returns: void.
+void aif_row_index_add(struct aif_row_index *index, size_t row_size) {
+    if (index->n_rows % index->interval == 0) {
+        index->offsets[index->n_rows / index->interval] = index->pos;
+    }
+    index->n_rows++;
+    index->pos += row_size;
+}
+
+// Description: Append the trailer after the last row.
+// Params:
+// - out: output positioned just after the last row
+// - index: index with every row added
+// Returns: TRUE on success, FALSE on write failure.
+int aif_row_index_write(struct aif_writer *out, const struct aif_row_index *index) {
+    uint8_t entry[AIF_ROW_INDEX_ENTRY_SIZE];
+    for (uint32_t i = 0; i < index->n_entries; i++) {
+        put_le_u64(entry, index->offsets[i]);
+        if (!aif_writer_write(out, entry, sizeof(entry))) {
+            return FALSE;
+        }
+    }
+
+    uint8_t footer[AIF_ROW_INDEX_FOOTER_SIZE];
+    put_le_u32(footer, index->interval);
+    put_le_u32(footer + 4, index->n_entries);
+    memcpy(footer + 8, AIF_ROW_INDEX_MAGIC, AIF_ROW_INDEX_MAGIC_SIZE);
+    return aif_writer_write(out, footer, sizeof(footer));
+}
+
+// Description: Free a collected index.
+// Params:
+// - index: index set up by aif_row_index_init
+// Returns: void.
+void aif_row_index_free(struct aif_row_index *index) {
+    free(index->offsets);
+    index->offsets = NULL;
+}
+
+// Description: Find the trailer of an RLE image. It is only accepted if
+//              it has the right number of entries for the image, the
+//              first is row 0 and the rest rise strictly through the row
+//              data before it.
+// Params:
+// - data: pixel data (first row length prefix onwards)
+// - size: bytes of pixel data, trailer included
+// - height: rows in the image (> 0)
+// - view: filled in if a trailer is found
+// Returns: TRUE if a valid trailer was found, otherwise FALSE.
+int aif_row_index_find(
+    const uint8_t *data,
+    size_t size,
+    uint32_t height,
+    struct aif_row_index_view *view
+) {
+    if (size < AIF_ROW_INDEX_FOOTER_SIZE) {
+        return FALSE;
+    }
+    const uint8_t *footer = data + size - AIF_ROW_INDEX_FOOTER_SIZE;
+    if (memcmp(footer + 8, AIF_ROW_INDEX_MAGIC, AIF_ROW_INDEX_MAGIC_SIZE) != 0) {
+        return FALSE;
+    }
+
+    uint32_t interval = read_le_u32(footer);
+    uint32_t n_entries = read_le_u32(footer + 4);
+    if (interval == 0 || n_entries != index_entries(height, interval)) {
+        return FALSE;
+    }
+    size_t entry_space = size - AIF_ROW_INDEX_FOOTER_SIZE;
+    if (entry_space / AIF_ROW_INDEX_ENTRY_SIZE < n_entries) {
+        return FALSE;
+    }
+    size_t rows_end = entry_space - (size_t)n_entries * AIF_ROW_INDEX_ENTRY_SIZE;
+
+    view->interval = interval;
+    view->n_entries = n_entries;
+    view->entries = data + rows_end;
+    view->rows_end = rows_end;
+    view->height = height;
+
+    for (uint32_t i = 0; i < n_entries; i++) {
+        uint64_t offset = aif_row_index_offset(view, i);
+        if (i == 0 ? offset != 0
+                   : offset <= aif_row_index_offset(view, i - 1)) {
+            return FALSE;
+        }
+        if (offset >= rows_end) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Description: Read one entry of a trailer.
+// Params:
+// - view: trailer found by aif_row_index_find
+// - entry: entry number (< n_entries)
+// Returns: offset of row entry * interval from the start of pixel data.
+uint64_t aif_row_index_offset(const struct aif_row_index_view *view, uint32_t entry) {
+    const uint8_t *p = view->entries + (size_t)entry * AIF_ROW_INDEX_ENTRY_SIZE;
+    return (uint64_t)read_le_u32(p) | ((uint64_t)read_le_u32(p + 4) << 32);
+}
+
+// Description: Look up an entry of a trailer and check it against the
+//              length prefixes, which the entries only repeat: from the
+//              entry's offset they must walk exactly interval rows to the
+//              next entry, or the rest of the image to the trailer for the
+//              last one. An entry that fails this is not used, so an index
+//              that rises through the data but points between rows cannot
+//              misplace a seek.
+// Params:
+// - view: trailer found by aif_row_index_find
+// - data: pixel data the trailer was found in
+// - prefix_size: bytes in each length prefix (AIF_RLE_PREFIX_SIZE)
+// - entry: entry number (< n_entries)
+// - pos: receives the offset of row entry * interval
+// Returns: TRUE if the entry agrees with the length prefixes, otherwise
+//          FALSE.
+int aif_row_index_lookup(
+    const struct aif_row_index_view *view,
+    const uint8_t *data,
+    size_t prefix_size,
+    uint32_t entry,
+    size_t *pos
+) {
+    uint64_t offset = aif_row_index_offset(view, entry);
+    uint32_t first = entry * view->interval;
+    uint32_t n_rows = view->height - first;
+    uint64_t end = view->rows_end;
+    if (entry + 1 < view->n_entries) {
+        n_rows = view->interval;
+        end = aif_row_index_offset(view, entry + 1);
+    }
+
+    size_t p = offset;
+    if (aif_scan_compressed_rows(data, view->rows_end, &p, prefix_size, n_rows,
+                                 NULL, NULL) < n_rows
+        || p != end) {
+        return FALSE;
+    }
+    *pos = offset;
+    return TRUE;
+}
@@ -0,0 +1,73 @@
+#ifndef AIF_INDEX_H
+#define AIF_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aif-io.h"
+
+// Optional trailer after the last row of an RLE image (of either prefix
+// size) giving the offset of every interval-th row, so a row can be found
+// without walking all the length prefixes before it. Decoders stop after
+// the last row, so files with a trailer still read everywhere. Layout,
+// all little-endian:
+//   u64 offset[n_entries]  from the start of pixel data to row i * interval
+//   u32 interval
+//   u32 n_entries
+//   "AIFINDEX"
+#define AIF_ROW_INDEX_INTERVAL 16
+#define AIF_ROW_INDEX_MAGIC "AIFINDEX"
+#define AIF_ROW_INDEX_MAGIC_SIZE 8
+#define AIF_ROW_INDEX_ENTRY_SIZE 8
+#define AIF_ROW_INDEX_FOOTER_SIZE (8 + AIF_ROW_INDEX_MAGIC_SIZE)
+
+// Row offsets collected while an image is written
+struct aif_row_index {
+    uint32_t interval;
+    uint32_t n_entries;
+    uint64_t *offsets;
+    // Rows added so far and the offset of the next one
+    uint32_t n_rows;
+    uint64_t pos;
+};
+
+// Index of an existing file; entries point into the file's data
+struct aif_row_index_view {
+    uint32_t interval;
+    uint32_t n_entries;
+    const uint8_t *entries;
+    // Bytes of row data before the trailer, and rows in the image
+    size_t rows_end;
+    uint32_t height;
+};
+
+// Prepares to index an image of height rows; returns FALSE if out of memory
+int aif_row_index_init(struct aif_row_index *index, uint32_t height);
+// Records the next row, written as row_size bytes (length prefix included)
+void aif_row_index_add(struct aif_row_index *index, size_t row_size);
+// Appends the trailer once every row has been added; returns FALSE on failure
+int aif_row_index_write(struct aif_writer *out, const struct aif_row_index *index);
+// Frees the offsets
+void aif_row_index_free(struct aif_row_index *index);
+
+// Looks for a valid trailer at the end of size bytes of pixel data;
+// returns FALSE if there is none
+int aif_row_index_find(
+    const uint8_t *data,
+    size_t size,
+    uint32_t height,
+    struct aif_row_index_view *view
+);
+// Returns the offset of row entry * interval
+uint64_t aif_row_index_offset(const struct aif_row_index_view *view, uint32_t entry);
+// Gives the offset of row entry * interval in *pos if the length prefixes
+// from there lead exactly to the next entry; returns FALSE if they do not
+int aif_row_index_lookup(
+    const struct aif_row_index_view *view,
+    const uint8_t *data,
+    size_t prefix_size,
+    uint32_t entry,
+    size_t *pos
+);
+
+#endif
@@ -0,0 +1,376 @@
+// Description: Input and output helpers for AIF files. Inputs are mapped
+//              into memory so stages can work on them without copying.
+//              Every output byte passes through the running checksum on its
+//              way out, so finishing a file only needs to patch the two
+//              checksum bytes in the header. Outputs are written to a
+//              temporary file beside them, synced and renamed into place
+//              once complete, so a failed run (or a crash) leaves any
+//              existing file (the input included) untouched. A replaced
+//              file keeps its mode and owner, and a symbolic link keeps
+//              pointing at the new output.
+
+#include "aif.h"
+#include "aif-io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Attempts at finding an unused temporary output name
+#define TEMP_NAME_TRIES 100
+// Room for the ".tmp-<pid>-<n>" ending of a temporary output name
+#define TEMP_SUFFIX_SIZE 48
+
+// Description: Read a 16-bit little-endian unsigned integer.
+// Params:
+// - buf: pointer to at least 2 bytes
+// Returns: uint16_t value read.
+uint16_t read_le_u16(const uint8_t *buf) {
+    return (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+// Description: Read a 32-bit little-endian unsigned integer.
+// Params:
+// - buf: pointer to at least 4 bytes
+// Returns: uint32_t value read.
+uint32_t read_le_u32(const uint8_t *buf) {
+    return (uint32_t)buf[0]
+         | ((uint32_t)buf[1] << 8)
+         | ((uint32_t)buf[2] << 16)
+         | ((uint32_t)buf[3] << 24);
+}
+
+// Description: Read a whole file into a malloc'd buffer, for inputs that
+//              cannot be mapped.
+// Params:
+// - r: reader to fill in
+// - fd: open input file descriptor
+// - size: expected file size
+// Returns: TRUE on success, FALSE on read failure.
+static int reader_slurp(struct aif_reader *r, int fd, size_t size) {
+    uint8_t *buf = malloc(size > 0 ? size : 1);
+    if (buf == NULL) {
+        return FALSE;
+    }
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, buf + got, size - got);
+        if (n < 0) {
+            free(buf);
+            return FALSE;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+
+    r->data = buf;
+    r->size = got;
+    r->mapped = FALSE;
+    return TRUE;
+}
+
+// Description: Open an input file and map it into memory.
+// Params:
+// - r: reader to initialise
+// - filename: input path
+// Returns: TRUE on success, FALSE if the file cannot be opened or read
+//          (or is too large to address).
+int aif_reader_open(struct aif_reader *r, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    // With a 32-bit size_t, files past 4 GB cannot be held in memory
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return FALSE;
+    }
+    size_t size = st.st_size;
+
+    void *map = MAP_FAILED;
+    if (size > 0) {
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    int ok = TRUE;
+    if (map != MAP_FAILED) {
+        // Stages walk the file front to back
+        madvise(map, size, MADV_SEQUENTIAL);
+        r->data = map;
+        r->size = size;
+        r->mapped = TRUE;
+    } else {
+        ok = reader_slurp(r, fd, size);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return ok;
+}
+
+// Description: Release an input file.
+// Params:
+// - r: reader
+// Returns: void.
+void aif_reader_close(struct aif_reader *r) {
+    if (r->mapped) {
+        munmap((void *)r->data, r->size);
+    } else {
+        free((void *)r->data);
+    }
+    r->data = NULL;
+    r->size = 0;
+}
+
+// Description: Write a whole buffer to a file descriptor, retrying short writes.
+// Params:
+// - fd: output file descriptor
+// - data: bytes to write
+// - n: number of bytes
+// Returns: TRUE on success, FALSE on failure.
+static int write_all(int fd, const uint8_t *data, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(fd, data, n);
+        if (written <= 0) {
+            return FALSE;
+        }
+        data += written;
+        n -= (size_t)written;
+    }
+    return TRUE;
+}
+
+// Description: Write out any buffered bytes.
+// Params:
+// - w: writer
+// Returns: TRUE on success, FALSE on failure.
+static int writer_flush(struct aif_writer *w) {
+    if (!write_all(w->fd, w->buf, w->len)) {
+        return FALSE;
+    }
+    w->len = 0;
+    return TRUE;
+}
+
+// Description: Create a temporary file to be renamed to the output. It
+//              goes in the same directory as the file it replaces, as
+//              rename() cannot move files between file systems, and its
+//              name is the start of that file's name cut short enough to
+//              stay within NAME_MAX.
+// Params:
+// - w: writer; target is the path to replace, temp_filename is set to
+//      the new file's name
+// Returns: descriptor of the new file, or -1 on failure.
+static int writer_create_temp(struct aif_writer *w) {
+    static unsigned int counter;
+
+    const char *slash = strrchr(w->target, '/');
+    size_t dir_len = slash != NULL ? (size_t)(slash - w->target) + 1 : 0;
+    const char *base = w->target + dir_len;
+    size_t len = dir_len + NAME_MAX + 1;
+    w->temp_filename = malloc(len);
+    if (w->temp_filename == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < TEMP_NAME_TRIES; i++) {
+        // Threads of a batch each need their own name
+        unsigned int n = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+        char suffix[TEMP_SUFFIX_SIZE];
+        int suffix_len = snprintf(suffix, sizeof(suffix), ".tmp-%ld-%u",
+                                  (long)getpid(), n);
+        int base_len = (int)strlen(base);
+        if (base_len > NAME_MAX - suffix_len) {
+            base_len = NAME_MAX - suffix_len;
+        }
+        snprintf(w->temp_filename, len, "%.*s%.*s%s", (int)dir_len, w->target,
+                 base_len, base, suffix);
+        int fd = open(w->temp_filename, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0 || errno != EEXIST) {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+// Description: Create an output file. Regular files (and new ones) are
+//              written under a temporary name until aif_writer_finish.
+//              A symbolic link is followed, so that its target is what
+//              gets replaced, and a file being replaced passes its mode
+//              and (where allowed) owner on to the new one. Anything
+//              else, such as a device, is written directly.
+// Params:
+// - w: writer to initialise
+// - filename: output path
+// Returns: TRUE on success, FALSE if the file could not be created.
+int aif_writer_open(struct aif_writer *w, const char *filename) {
+    w->filename = filename;
+    w->target = NULL;
+    w->temp_filename = NULL;
+    w->len = 0;
+    aif_checksum_init(&w->checksum);
+
+    w->buf = malloc(AIF_WRITER_BUFFER_SIZE);
+    if (w->buf == NULL) {
+        return FALSE;
+    }
+
+    struct stat st;
+    int exists = stat(filename, &st) == 0;
+    if (exists && !S_ISREG(st.st_mode)) {
+        w->fd = open(filename, O_WRONLY | O_TRUNC);
+    } else {
+        w->target = exists ? realpath(filename, NULL) : strdup(filename);
+        w->fd = w->target != NULL ? writer_create_temp(w) : -1;
+        if (w->fd >= 0 && exists) {
+            // Only root may give a file away; others keep at least the
+            // group where they belong to it, and own the file themselves
+            // as they would after rewriting it in place
+            if (fchown(w->fd, st.st_uid, st.st_gid) != 0) {
+                (void)fchown(w->fd, -1, st.st_gid);
+            }
+            if (fchmod(w->fd, st.st_mode & 07777) != 0) {
+                close(w->fd);
+                unlink(w->temp_filename);
+                w->fd = -1;
+            }
+        }
+    }
+    if (w->fd < 0) {
+        free(w->temp_filename);
+        free(w->target);
+        free(w->buf);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Description: Append bytes to the output, checksumming them on the way.
+// Params:
+// - w: writer
+// - data: bytes to append
+// - n: number of bytes
+// Returns: TRUE on success, FALSE on write failure.
+int aif_writer_write(struct aif_writer *w, const void *data, size_t n) {
+    const uint8_t *bytes = data;
+    aif_checksum_update(&w->checksum, bytes, n);
+
+    if (w->len + n > AIF_WRITER_BUFFER_SIZE) {
+        if (!writer_flush(w)) {
+            return FALSE;
+        }
+        // Large writes skip the buffer entirely
+        if (n >= AIF_WRITER_BUFFER_SIZE) {
+            return write_all(w->fd, bytes, n);
+        }
+    }
+
+    memcpy(w->buf + w->len, bytes, n);
+    w->len += n;
+    return TRUE;
+}
+
+// Description: Reserve space at the end of the write buffer so output can
+//              be produced in place instead of being copied in by
+//              aif_writer_write. The space only becomes part of the file
+//              once aif_writer_commit is called.
+// Params:
+// - w: writer
+// - n: number of bytes wanted
+// Returns: pointer to n writable bytes, or NULL if n is larger than the
+//          buffer or flushing it failed (aif_writer_write reports the
+//          error again).
+uint8_t *aif_writer_reserve(struct aif_writer *w, size_t n) {
+    if (n > AIF_WRITER_BUFFER_SIZE) {
+        return NULL;
+    }
+    if (w->len + n > AIF_WRITER_BUFFER_SIZE && !writer_flush(w)) {
+        return NULL;
+    }
+    return w->buf + w->len;
+}
+
+// Description: Append bytes previously reserved with aif_writer_reserve
+//              and since filled in by the caller.
+// Params:
+// - w: writer
+// - n: number of reserved bytes to append
+// Returns: void.
+void aif_writer_commit(struct aif_writer *w, size_t n) {
+    aif_checksum_update(&w->checksum, w->buf + w->len, n);
+    w->len += n;
+}
+
+// Description: Flush the output, store the checksum, close the file and
+//              move it into place.
+// Params:
+// - w: writer; the header must already have been written through it
+// Returns: TRUE on success, FALSE on failure (the output path is then
+//          left as it was).
+int aif_writer_finish(struct aif_writer *w) {
+    int ok = writer_flush(w);
+
+    uint16_t checksum = aif_checksum_value(&w->checksum);
+    uint8_t checksum_bytes[AIF_CHECKSUM_SIZE] = {
+        checksum & 0xFF,
+        (checksum >> 8) & 0xFF
+    };
+
+    if (ok) {
+        ssize_t n = pwrite(w->fd, checksum_bytes, AIF_CHECKSUM_SIZE,
+                           AIF_CHECKSUM_OFFSET);
+        ok = (n == AIF_CHECKSUM_SIZE);
+    }
+
+    // The data must be on disk before the rename, or a crash could leave
+    // an empty file where the old output was
+    if (ok && w->temp_filename != NULL && fsync(w->fd) != 0) {
+        ok = FALSE;
+    }
+    if (close(w->fd) != 0) {
+        ok = FALSE;
+    }
+    if (w->temp_filename != NULL) {
+        if (ok && rename(w->temp_filename, w->target) != 0) {
+            ok = FALSE;
+        }
+        if (!ok) {
+            unlink(w->temp_filename);
+        }
+        free(w->temp_filename);
+        free(w->target);
+    }
+    free(w->buf);
+    return ok;
+}
+
+// Description: Discard a partially written output file. Only the
+//              temporary file is removed; the output path is left as it
+//              was.
+// Params:
+// - w: writer
+// Returns: void.
+void aif_writer_abort(struct aif_writer *w) {
+    close(w->fd);
+    free(w->buf);
+    if (w->temp_filename != NULL) {
+        unlink(w->temp_filename);
+        free(w->temp_filename);
+        free(w->target);
+    }
+}
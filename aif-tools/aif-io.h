@@ -0,0 +1,59 @@
+#ifndef AIF_IO_H
+#define AIF_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aif-checksum.h"
+
+#define AIF_WRITER_BUFFER_SIZE (1 << 20)
+
+// Reads a 16-bit little-endian unsigned integer
+uint16_t read_le_u16(const uint8_t *buf);
+// Reads a 32-bit little-endian unsigned integer
+uint32_t read_le_u32(const uint8_t *buf);
+
+// Read-only view of a whole input file, memory-mapped where possible so
+// pixel data can be used straight from the page cache.
+struct aif_reader {
+    const uint8_t *data;
+    size_t size;
+    int mapped;
+};
+
+// Maps filename into memory; returns FALSE if it cannot be opened or read
+int aif_reader_open(struct aif_reader *r, const char *filename);
+// Releases the view of the file
+void aif_reader_close(struct aif_reader *r);
+
+// Buffered output file that checksums every byte as it is written, so the
+// header checksum can be patched in place without reading the file back.
+// The bytes go to a temporary file (temp_filename, NULL when writing
+// straight to a device) that replaces target, filename with any symbolic
+// links resolved, only once it is finished.
+struct aif_writer {
+    const char *filename;
+    char *target;
+    char *temp_filename;
+    int fd;
+    uint8_t *buf;
+    size_t len;
+    struct aif_checksum checksum;
+};
+
+// Starts writing filename; returns FALSE on failure
+int aif_writer_open(struct aif_writer *w, const char *filename);
+// Appends n bytes to the file; returns FALSE on failure
+int aif_writer_write(struct aif_writer *w, const void *data, size_t n);
+// Returns space for n bytes at the end of the file to be filled in place,
+// or NULL if that is not possible
+uint8_t *aif_writer_reserve(struct aif_writer *w, size_t n);
+// Appends the first n bytes of the space returned by aif_writer_reserve
+void aif_writer_commit(struct aif_writer *w, size_t n);
+// Flushes, stores the checksum in the header, closes and moves the file to
+// its name; returns FALSE on failure
+int aif_writer_finish(struct aif_writer *w);
+// Closes and removes a partially written file, leaving filename untouched
+void aif_writer_abort(struct aif_writer *w);
+
+#endif
@@ -0,0 +1,113 @@
+// Description: Byte lookup tables applied to pixel buffers. Any per-byte
+//              mapping (such as brightening a gray channel) can be built
+//              once into a 256-entry table and then applied without
+//              recomputing it per pixel.
+//
+//              The AVX2 kernel splits the table into 16 rows of 16 bytes
+//              and looks each row up with a byte shuffle. Input bytes are
+//              offset so that only bytes whose high nibble selects the
+//              current row have a clear top bit; the shuffle zeroes every
+//              other lane, so OR-ing the 16 partial results gives the
+//              full lookup.
+
+#include "aif-lut.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AIF_LUT_X86 1
+#include <immintrin.h>
+#endif
+
+// Rows of 16 entries in the table
+#define LUT_ROWS 16
+
+// Description: Scalar table lookup.
+// Params:
+// - lut: 256-entry table
+// - in: input bytes
+// - out: output bytes (may be the same buffer as in)
+// - n: number of bytes
+// Returns: void.
+static void lut_apply_scalar(
+    const uint8_t *lut,
+    const uint8_t *in,
+    uint8_t *out,
+    size_t n
+) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = lut[in[i]];
+    }
+}
+
+#ifdef AIF_LUT_X86
+
+// Description: Table lookup of 64 bytes at a time with AVX2 shuffles. Two
+//              vectors are in flight at once and the row loop is unrolled
+//              so the shuffles are not serialised on one dependency chain.
+//              (A 16-byte SSSE3 version of this kernel is slower than the
+//              scalar loop, so there is none.)
+// Params:
+// - lut: 256-entry table
+// - in: input bytes
+// - out: output bytes (may be the same buffer as in)
+// - n: number of bytes
+// Returns: void.
+__attribute__((target("avx2")))
+static void lut_apply_avx2(
+    const uint8_t *lut,
+    const uint8_t *in,
+    uint8_t *out,
+    size_t n
+) {
+    // vpshufb looks up within each 128-bit lane, so every row is
+    // repeated in both lanes
+    __m256i rows[LUT_ROWS];
+    for (int r = 0; r < LUT_ROWS; r++) {
+        __m128i row = _mm_loadu_si128((const __m128i *)(lut + r * 16));
+        rows[r] = _mm256_broadcastsi128_si256(row);
+    }
+    const __m256i row_step = _mm256_set1_epi8(16);
+    const __m256i bias = _mm256_set1_epi8(0x70);
+
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        // x counts down one row per step; adding 0x70 with saturation
+        // leaves the top bit clear only while x is in 0..15
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(in + i + 32));
+        __m256i result0 = _mm256_setzero_si256();
+        __m256i result1 = _mm256_setzero_si256();
+#pragma GCC unroll 16
+        for (int r = 0; r < LUT_ROWS; r++) {
+            __m256i idx0 = _mm256_adds_epu8(x0, bias);
+            __m256i idx1 = _mm256_adds_epu8(x1, bias);
+            result0 = _mm256_or_si256(result0, _mm256_shuffle_epi8(rows[r], idx0));
+            result1 = _mm256_or_si256(result1, _mm256_shuffle_epi8(rows[r], idx1));
+            x0 = _mm256_sub_epi8(x0, row_step);
+            x1 = _mm256_sub_epi8(x1, row_step);
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), result0);
+        _mm256_storeu_si256((__m256i *)(out + i + 32), result1);
+    }
+    lut_apply_scalar(lut, in + i, out + i, n - i);
+}
+
+#endif
+
+// Description: Map bytes through a lookup table using the fastest kernel
+//              the CPU supports.
+// Params:
+// - lut: 256-entry table
+// - in: input bytes
+// - out: output bytes (may be the same buffer as in)
+// - n: number of bytes
+// Returns: void.
+void aif_lut_apply(const uint8_t *lut, const uint8_t *in, uint8_t *out, size_t n) {
+#ifdef AIF_LUT_X86
+    if (__builtin_cpu_supports("avx2")) {
+        lut_apply_avx2(lut, in, out, n);
+        return;
+    }
+#endif
+
+    lut_apply_scalar(lut, in, out, n);
+}
@@ -0,0 +1,13 @@
+#ifndef AIF_LUT_H
+#define AIF_LUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of entries in a byte lookup table
+#define AIF_LUT_SIZE 256
+
+// Maps n bytes through a 256-entry table: out[i] = lut[in[i]]
+void aif_lut_apply(const uint8_t *lut, const uint8_t *in, uint8_t *out, size_t n);
+
+#endif
@@ -0,0 +1,174 @@
+// Description: Minimal thread pool. Workers sleep until a batch is posted,
+//              then pull task indices from a shared counter until the batch
+//              is exhausted.
+
+#include "aif-pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct aif_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    pthread_t *threads;
+    int n_workers;
+    int shutdown;
+
+    // Current batch
+    unsigned generation;
+    aif_task_fn fn;
+    void *ctx;
+    size_t n_tasks;
+    size_t next;
+    size_t finished;
+};
+
+// Description: Count the CPUs available to this process.
+// Params: none.
+// Returns: number of online CPUs, at least 1.
+int aif_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        return 1;
+    }
+    return (int)n;
+}
+
+// Description: Run tasks from the current batch until none are left.
+// Params:
+// - pool: pool whose lock is held by the caller
+// Returns: void; returns with the lock still held.
+static void pool_run_tasks(struct aif_pool *pool) {
+    while (pool->next < pool->n_tasks) {
+        size_t index = pool->next;
+        pool->next++;
+        aif_task_fn fn = pool->fn;
+        void *ctx = pool->ctx;
+
+        pthread_mutex_unlock(&pool->lock);
+        fn(ctx, index);
+        pthread_mutex_lock(&pool->lock);
+
+        pool->finished++;
+        if (pool->finished == pool->n_tasks) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+}
+
+// Description: Worker thread body.
+// Params:
+// - arg: owning pool
+// Returns: NULL.
+static void *pool_worker(void *arg) {
+    struct aif_pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    unsigned seen = pool->generation;
+    while (1) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pool_run_tasks(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// Description: Start a pool of worker threads.
+// Params:
+// - n_threads: total threads per batch, including the caller
+// Returns: new pool, or NULL if out of memory.
+struct aif_pool *aif_pool_create(int n_threads) {
+    struct aif_pool *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    int n_workers = n_threads - 1;
+    if (n_workers < 0) {
+        n_workers = 0;
+    }
+
+    pool->threads = malloc(sizeof(pthread_t) * (n_workers + 1));
+    if (pool->threads == NULL) {
+        aif_pool_destroy(pool);
+        return NULL;
+    }
+
+    // Fewer workers than asked for is still a working pool
+    for (int i = 0; i < n_workers; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            break;
+        }
+        pool->n_workers++;
+    }
+
+    return pool;
+}
+
+// Description: Run a batch of tasks and wait for it to complete.
+// Params:
+// - pool: pool to run on
+// - n_tasks: number of tasks in the batch
+// - fn: task function
+// - ctx: context passed to every task
+// Returns: void.
+void aif_pool_run(struct aif_pool *pool, size_t n_tasks, aif_task_fn fn, void *ctx) {
+    if (n_tasks == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->n_tasks = n_tasks;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation++;
+    if (pool->n_workers > 0 && n_tasks > 1) {
+        pthread_cond_broadcast(&pool->work_ready);
+    }
+
+    pool_run_tasks(pool);
+    while (pool->finished < pool->n_tasks) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Description: Stop all workers and free the pool.
+// Params:
+// - pool: pool to destroy (may be NULL)
+// Returns: void.
+void aif_pool_destroy(struct aif_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->n_workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,22 @@
+#ifndef AIF_POOL_H
+#define AIF_POOL_H
+
+#include <stddef.h>
+
+// Fixed set of worker threads that repeatedly run batches of
+// independent tasks. The calling thread takes part in every batch.
+struct aif_pool;
+
+// A task receives the shared batch context and its index in the batch
+typedef void (*aif_task_fn)(void *ctx, size_t index);
+
+// Returns the number of online CPUs (at least 1)
+int aif_cpu_count(void);
+// Starts a pool that runs batches on n_threads threads in total
+struct aif_pool *aif_pool_create(int n_threads);
+// Runs fn(ctx, 0) .. fn(ctx, n_tasks - 1) and waits for all of them
+void aif_pool_run(struct aif_pool *pool, size_t n_tasks, aif_task_fn fn, void *ctx);
+// Stops the workers and frees the pool
+void aif_pool_destroy(struct aif_pool *pool);
+
+#endif
@@ -0,0 +1,1076 @@
+// Description: Run-length encoding of AIF pixel rows. Each compressed row
+//              is stored as a little-endian length (2 bytes, or 4 for
+//              AIF_COMPRESSION_RLE_WIDE) followed by repeat blocks
+//              (count, pixel) and literal blocks (0, count, pixels...).
+
+#include "aif.h"
+#include "aif-index.h"
+#include "aif-io.h"
+#include "aif-rle.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AIF_RLE_X86 1
+#include <immintrin.h>
+#endif
+
+#define FALSE 0
+#define TRUE 1
+
+// Description: Compare two pixels of size bpp for equality.
+// Params:
+// - a: pixel pointer
+// - b: pixel pointer
+// - bpp: bytes per pixel
+// Returns: TRUE if identical, else FALSE.
+static inline int pixels_equal(const uint8_t *a, const uint8_t *b, size_t bpp) {
+    for (size_t k = 0; k < bpp; k++) {
+        if (a[k] != b[k]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Neighbour scans handed to the SIMD kernels once a run or literal stretch
+// has lasted this many pixels; shorter ones are cheaper to finish inline
+#define SIMD_SCAN_AFTER 8
+
+// Bulk scans over a row. run_end returns the first column at or after
+// start that differs from its left neighbour; literal_end returns the first
+// column at or after start equal to its right neighbour. Both return width
+// if there is no such column.
+typedef uint32_t (*rle_scan_fn)(const uint8_t *row, uint32_t width, uint32_t start);
+
+struct rle_kernels {
+    rle_scan_fn run_end;
+    rle_scan_fn literal_end;
+};
+
+#ifdef AIF_RLE_X86
+
+// Bit 3k of a 48-bit byte mask, for each of the 16 pixels it covers
+#define RGB8_PIXEL_BITS 0x249249249249ULL
+
+// Description: Reduce a mask of equal bytes (byte i vs byte i + 3) to a
+//              mask of equal RGB pixels.
+// Params:
+// - m: 48-bit byte equality mask covering 16 pixels
+// Returns: mask with bit 3k set iff pixel k equals pixel k + 1.
+static inline uint64_t rgb8_pixel_mask(uint64_t m) {
+    return m & (m >> 1) & (m >> 2) & RGB8_PIXEL_BITS;
+}
+
+// Description: Scalar tail of run_end once fewer than a vector of pixel
+//              pairs remain.
+// Params:
+// - row: row data buffer
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// - col: first column to compare with its left neighbour
+// Returns: first column at or after col that differs from its left
+//          neighbour, or width.
+static inline uint32_t run_end_tail(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint32_t col
+) {
+    while (col < width) {
+        const uint8_t *prev = row + (size_t)(col - 1) * bpp;
+        if (memcmp(prev, prev + bpp, bpp) != 0) {
+            break;
+        }
+        col++;
+    }
+    return col;
+}
+
+// Description: Scalar tail of literal_end once fewer than a vector of pixel
+//              pairs remain.
+// Params:
+// - row: row data buffer
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// - col: first column to consider
+// Returns: first column at or after col equal to its right neighbour, or
+//          width.
+static inline uint32_t literal_end_tail(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint32_t col
+) {
+    while (col + 1 < width) {
+        const uint8_t *pixel = row + (size_t)col * bpp;
+        if (memcmp(pixel, pixel + bpp, bpp) == 0) {
+            return col;
+        }
+        col++;
+    }
+    return width;
+}
+
+// Description: Neighbour equality of 16 GRAY8 pixel pairs (SSE2).
+// Params:
+// - row: row data; 17 bytes from pixel p must be readable
+// - p: first pair (p, p + 1)
+// Returns: mask with bit k set iff pixel p + k equals pixel p + k + 1.
+__attribute__((target("sse2")))
+static inline uint32_t gray8_pairs_sse2(const uint8_t *row, uint32_t p) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(row + p));
+    __m128i b = _mm_loadu_si128((const __m128i *)(row + p + 1));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+
+// Description: Neighbour equality of 16 RGB8 pixel pairs (SSE2).
+// Params:
+// - row: row data; 17 pixels from pixel p must be readable
+// - p: first pair (p, p + 1)
+// Returns: mask with bit 3k set iff pixel p + k equals pixel p + k + 1.
+__attribute__((target("sse2")))
+static inline uint64_t rgb8_pairs_sse2(const uint8_t *row, uint32_t p) {
+    const uint8_t *b = row + (size_t)p * 3;
+    uint64_t m = 0;
+    for (int i = 0; i < 3; i++) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(b + i * 16));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i * 16 + 3));
+        m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) << (i * 16);
+    }
+    return rgb8_pixel_mask(m);
+}
+
+// Description: Neighbour equality of 32 GRAY8 pixel pairs (AVX2).
+// Params:
+// - row: row data; 33 bytes from pixel p must be readable
+// - p: first pair (p, p + 1)
+// Returns: mask with bit k set iff pixel p + k equals pixel p + k + 1.
+__attribute__((target("avx2")))
+static inline uint32_t gray8_pairs_avx2(const uint8_t *row, uint32_t p) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(row + p));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(row + p + 1));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+
+// Description: Neighbour equality of 32 RGB8 pixel pairs (AVX2), as two
+//              48-bit halves of 16 pixels each.
+// Params:
+// - row: row data; 33 pixels from pixel p must be readable
+// - p: first pair (p, p + 1)
+// - lo: pixel mask for pairs p .. p + 15
+// - hi: pixel mask for pairs p + 16 .. p + 31
+// Returns: void.
+__attribute__((target("avx2")))
+static inline void rgb8_pairs_avx2(
+    const uint8_t *row,
+    uint32_t p,
+    uint64_t *lo,
+    uint64_t *hi
+) {
+    const uint8_t *b = row + (size_t)p * 3;
+    uint32_t m[3];
+    for (int i = 0; i < 3; i++) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(b + i * 32));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i * 32 + 3));
+        m[i] = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+    }
+    *lo = rgb8_pixel_mask(m[0] | ((uint64_t)(m[1] & 0xFFFF) << 32));
+    *hi = rgb8_pixel_mask((m[1] >> 16) | ((uint64_t)m[2] << 16));
+}
+
+// Scan kernels for struct rle_kernels. Each walks whole vectors of pixel
+// pairs while at least one full vector (plus the neighbour of its last
+// pixel) fits in the row, then finishes with the scalar tail.
+__attribute__((target("sse2")))
+static uint32_t run_end_gray8_sse2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start - 1;
+    while (p + 17 <= width) {
+        uint32_t diff = ~gray8_pairs_sse2(row, p) & 0xFFFF;
+        if (diff != 0) {
+            return p + (uint32_t)__builtin_ctz(diff) + 1;
+        }
+        p += 16;
+    }
+    return run_end_tail(row, width, 1, p + 1);
+}
+
+__attribute__((target("sse2")))
+static uint32_t literal_end_gray8_sse2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start;
+    while (p + 17 <= width) {
+        uint32_t same = gray8_pairs_sse2(row, p);
+        if (same != 0) {
+            return p + (uint32_t)__builtin_ctz(same);
+        }
+        p += 16;
+    }
+    return literal_end_tail(row, width, 1, p);
+}
+
+__attribute__((target("sse2")))
+static uint32_t run_end_rgb8_sse2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start - 1;
+    while (p + 17 <= width) {
+        uint64_t diff = ~rgb8_pairs_sse2(row, p) & RGB8_PIXEL_BITS;
+        if (diff != 0) {
+            return p + (uint32_t)__builtin_ctzll(diff) / 3 + 1;
+        }
+        p += 16;
+    }
+    return run_end_tail(row, width, 3, p + 1);
+}
+
+__attribute__((target("sse2")))
+static uint32_t literal_end_rgb8_sse2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start;
+    while (p + 17 <= width) {
+        uint64_t same = rgb8_pairs_sse2(row, p);
+        if (same != 0) {
+            return p + (uint32_t)__builtin_ctzll(same) / 3;
+        }
+        p += 16;
+    }
+    return literal_end_tail(row, width, 3, p);
+}
+
+__attribute__((target("avx2")))
+static uint32_t run_end_gray8_avx2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start - 1;
+    while (p + 33 <= width) {
+        uint32_t diff = ~gray8_pairs_avx2(row, p);
+        if (diff != 0) {
+            return p + (uint32_t)__builtin_ctz(diff) + 1;
+        }
+        p += 32;
+    }
+    return run_end_tail(row, width, 1, p + 1);
+}
+
+__attribute__((target("avx2")))
+static uint32_t literal_end_gray8_avx2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start;
+    while (p + 33 <= width) {
+        uint32_t same = gray8_pairs_avx2(row, p);
+        if (same != 0) {
+            return p + (uint32_t)__builtin_ctz(same);
+        }
+        p += 32;
+    }
+    return literal_end_tail(row, width, 1, p);
+}
+
+__attribute__((target("avx2")))
+static uint32_t run_end_rgb8_avx2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start - 1;
+    while (p + 33 <= width) {
+        uint64_t lo, hi;
+        rgb8_pairs_avx2(row, p, &lo, &hi);
+        uint64_t diff = ~lo & RGB8_PIXEL_BITS;
+        if (diff != 0) {
+            return p + (uint32_t)__builtin_ctzll(diff) / 3 + 1;
+        }
+        diff = ~hi & RGB8_PIXEL_BITS;
+        if (diff != 0) {
+            return p + 16 + (uint32_t)__builtin_ctzll(diff) / 3 + 1;
+        }
+        p += 32;
+    }
+    return run_end_tail(row, width, 3, p + 1);
+}
+
+__attribute__((target("avx2")))
+static uint32_t literal_end_rgb8_avx2(const uint8_t *row, uint32_t width, uint32_t start) {
+    uint32_t p = start;
+    while (p + 33 <= width) {
+        uint64_t lo, hi;
+        rgb8_pairs_avx2(row, p, &lo, &hi);
+        if (lo != 0) {
+            return p + (uint32_t)__builtin_ctzll(lo) / 3;
+        }
+        if (hi != 0) {
+            return p + 16 + (uint32_t)__builtin_ctzll(hi) / 3;
+        }
+        p += 32;
+    }
+    return literal_end_tail(row, width, 3, p);
+}
+
+static const struct rle_kernels gray8_sse2 = { run_end_gray8_sse2, literal_end_gray8_sse2 };
+static const struct rle_kernels rgb8_sse2 = { run_end_rgb8_sse2, literal_end_rgb8_sse2 };
+static const struct rle_kernels gray8_avx2 = { run_end_gray8_avx2, literal_end_gray8_avx2 };
+static const struct rle_kernels rgb8_avx2 = { run_end_rgb8_avx2, literal_end_rgb8_avx2 };
+
+#endif
+
+// Description: Pick the SIMD scan kernels for a pixel size.
+// Params:
+// - bpp: bytes per pixel
+// Returns: kernels for this CPU, or NULL to scan with scalar code only.
+static const struct rle_kernels *rle_kernels_for(size_t bpp) {
+#ifdef AIF_RLE_X86
+    int avx2 = __builtin_cpu_supports("avx2");
+    if (bpp == 1) {
+        return avx2 ? &gray8_avx2 : &gray8_sse2;
+    }
+    if (bpp == 3) {
+        return avx2 ? &rgb8_avx2 : &rgb8_sse2;
+    }
+#endif
+    (void)bpp;
+    return NULL;
+}
+
+// Description: Find where the run containing column start - 1 ends, by
+//              comparing each pixel with its left neighbour. Long runs are
+//              finished by the SIMD kernels.
+// Params:
+// - row: row data buffer
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// - start: first column to compare with its left neighbour (>= 1)
+// - kernels: SIMD scan kernels, or NULL
+// Returns: first column at or after start that differs from its left
+//          neighbour, or width.
+static inline uint32_t find_run_end(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint32_t start,
+    const struct rle_kernels *kernels
+) {
+    uint32_t col = start;
+    while (col < width) {
+        if (kernels != NULL && col - start == SIMD_SCAN_AFTER) {
+            return kernels->run_end(row, width, col);
+        }
+        const uint8_t *prev = row + (size_t)(col - 1) * bpp;
+        if (!pixels_equal(prev, prev + bpp, bpp)) {
+            break;
+        }
+        col++;
+    }
+    return col;
+}
+
+// Description: Find where a stretch of literal pixels ends, i.e. the next
+//              column that starts a run of two or more identical pixels.
+//              Long stretches are finished by the SIMD kernels.
+// Params:
+// - row: row data buffer
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// - start: first column to consider
+// - kernels: SIMD scan kernels, or NULL
+// Returns: first column at or after start equal to its right neighbour,
+//          or width if there is none.
+static inline uint32_t find_literal_end(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint32_t start,
+    const struct rle_kernels *kernels
+) {
+    uint32_t col = start;
+    while (col + 1 < width) {
+        if (kernels != NULL && col - start == SIMD_SCAN_AFTER) {
+            return kernels->literal_end(row, width, col);
+        }
+        const uint8_t *pixel = row + (size_t)col * bpp;
+        if (pixels_equal(pixel, pixel + bpp, bpp)) {
+            return col;
+        }
+        col++;
+    }
+    return width;
+}
+
+// Description: Emit one or more repeat blocks for a run of identical pixels.
+// Params:
+// - pixel: pixel bytes
+// - run: run length in pixels
+// - bpp: bytes per pixel
+// - out: output buffer
+// - out_pos: output cursor
+// Returns: void.
+static inline void write_repeat_blocks(
+    const uint8_t *pixel, 
+    size_t run, 
+    size_t bpp, 
+    uint8_t *out,
+    size_t *out_pos
+) {
+    size_t remaining = run;
+    while (remaining > 0) {
+        uint8_t chunk;
+        if (remaining > 255) {
+            chunk = 255;
+        } else {
+            chunk = (uint8_t)remaining;
+        }
+
+        out[*out_pos] = chunk;
+        *out_pos = *out_pos + 1;
+
+        for (size_t k = 0; k < bpp; k++) {
+            out[*out_pos] = pixel[k];
+            *out_pos = *out_pos + 1;
+        }
+
+        remaining = remaining - chunk;
+    }
+}
+
+// Description: Emit literal blocks for a sequence of non-repeating pixels.
+// Params:
+// - row: row data buffer
+// - start: starting column
+// - literal_pixels: number of pixels to emit
+// - bpp: bytes per pixel
+// - out: output buffer
+// - out_pos: output cursor
+// Returns: void.
+static inline void write_literal_blocks(
+    const uint8_t *row,
+    uint32_t start,
+    size_t literal_pixels,
+    size_t bpp,
+    uint8_t *out,
+    size_t *out_pos
+) {
+    size_t emitted = 0;
+    while (emitted < literal_pixels) {
+        uint8_t chunk;
+        if (literal_pixels - emitted > 255) {
+            chunk = 255;
+        } else {
+            chunk = (uint8_t)(literal_pixels - emitted);
+        }
+
+        out[*out_pos] = 0;
+        *out_pos = *out_pos + 1;
+        out[*out_pos] = chunk;
+        *out_pos = *out_pos + 1;
+
+        size_t base = ((size_t)start + emitted) * bpp;
+        memcpy(out + *out_pos, row + base, (size_t)chunk * bpp);
+        *out_pos = *out_pos + (size_t)chunk * bpp;
+
+        emitted = emitted + chunk;
+    }
+}
+
+// Description: Single-pass run/literal tokenizer shared by the
+//              bpp-specialised compressors below. Every pixel is compared
+//              with its right neighbour exactly once.
+// Params:
+// - row: row data buffer
+// - width: number of pixels in row
+// - bpp: bytes per pixel
+// - out: output buffer
+// - kernels: SIMD scan kernels for bpp, or NULL
+// Returns: number of bytes written to out.
+static inline __attribute__((always_inline)) size_t compress_row_bpp(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint8_t *out,
+    const struct rle_kernels *kernels
+) {
+    size_t out_pos = 0;
+    uint32_t col = 0;
+
+    // Whether pixels col and col + 1 are already known to be equal
+    int run_known = FALSE;
+
+    while (col < width) {
+        uint32_t run_end;
+        if (run_known) {
+            run_end = find_run_end(row, width, bpp, col + 2, kernels);
+        } else {
+            run_end = find_run_end(row, width, bpp, col + 1, kernels);
+        }
+
+        if (run_end - col >= 2) {
+            const uint8_t *pixel = row + ((size_t)col * bpp);
+            write_repeat_blocks(pixel, run_end - col, bpp, out, &out_pos);
+            col = run_end;
+            run_known = FALSE;
+            continue;
+        }
+
+        // No run: gather literals until the next run or row end
+        uint32_t lit_end = find_literal_end(row, width, bpp, col + 1, kernels);
+        write_literal_blocks(row, col, lit_end - col, bpp, out, &out_pos);
+        col = lit_end;
+        run_known = (col < width);
+    }
+
+    return out_pos;
+}
+
+// Description: Compress an 8-bit grayscale row.
+// Params:
+// - row: row data buffer
+// - width: number of pixels in row
+// - out: output buffer
+// Returns: number of bytes written to out.
+static size_t compress_row_gray8(const uint8_t *row, uint32_t width, uint8_t *out) {
+    return compress_row_bpp(row, width, 1, out, rle_kernels_for(1));
+}
+
+// Description: Compress an 8-bit RGB row.
+// Params:
+// - row: row data buffer
+// - width: number of pixels in row
+// - out: output buffer
+// Returns: number of bytes written to out.
+static size_t compress_row_rgb8(const uint8_t *row, uint32_t width, uint8_t *out) {
+    return compress_row_bpp(row, width, 3, out, rle_kernels_for(3));
+}
+
+// Description: Compress a single row into the provided buffer.
+// Params:
+// - row: row data buffer
+// - width: number of pixels in row
+// - bpp: bytes per pixel
+// - out: output buffer
+// Returns: number of bytes written to out.
+size_t compress_row(
+    const uint8_t *row, 
+    uint32_t width, 
+    size_t bpp, 
+    uint8_t *out
+) {
+    switch (bpp) {
+    case 1:
+        return compress_row_gray8(row, width, out);
+    case 3:
+        return compress_row_rgb8(row, width, out);
+    default:
+        return compress_row_bpp(row, width, bpp, out, NULL);
+    }
+}
+
+// Description: Re-encode a row given as a sequence of runs, producing
+//              exactly what compress_row would for the expanded row.
+//              Neighbouring runs of the same pixel are merged first, so
+//              runs that only became equal after a transform are joined.
+// Params:
+// - pixels: pixel of each run, packed
+// - counts: length of each run in pixels
+// - n_runs: number of runs
+// - bpp: bytes per pixel
+// - out: output buffer
+// Returns: number of bytes written to out.
+size_t aif_rle_encode_runs(
+    const uint8_t *pixels,
+    const uint8_t *counts,
+    uint32_t n_runs,
+    size_t bpp,
+    uint8_t *out
+) {
+    const struct rle_kernels *kernels = rle_kernels_for(bpp);
+    size_t out_pos = 0;
+    uint32_t i = 0;
+
+    while (i < n_runs) {
+        const uint8_t *pixel = pixels + (size_t)i * bpp;
+        size_t run = counts[i];
+        uint32_t next = i + 1;
+        while (next < n_runs && pixels_equal(pixel, pixels + (size_t)next * bpp, bpp)) {
+            run += counts[next];
+            next++;
+        }
+
+        if (run >= 2) {
+            write_repeat_blocks(pixel, run, bpp, out, &out_pos);
+            i = next;
+            continue;
+        }
+
+        // Single pixels up to the next run of two or more are literals;
+        // they are already packed next to each other in pixels. That run
+        // is either two equal neighbours or a run that was already longer
+        // than one pixel.
+        uint32_t lit_end = find_literal_end(pixels, n_runs, bpp, i + 1, kernels);
+        for (uint32_t k = i + 1; k < lit_end; k++) {
+            if (counts[k] != 1) {
+                lit_end = k;
+                break;
+            }
+        }
+        write_literal_blocks(pixels, i, lit_end - i, bpp, out, &out_pos);
+        i = lit_end;
+    }
+
+    return out_pos;
+}
+
+// Description: Longest row compress_row can produce. Pixels that differ
+//              from both neighbours cost the most: either every pixel in
+//              literal blocks, or, for pixels of under 3 bytes, a 1-pixel
+//              literal block and a 2-pixel repeat block in turn (2 * bpp + 3
+//              bytes per 3 pixels). AIF_RLE_MAX_ROW is looser, and only
+//              sizes buffers.
+// Params:
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// Returns: upper bound on the compressed length of the row.
+static uint64_t worst_row_len(uint32_t width, size_t bpp) {
+    uint64_t literals = (uint64_t)width * bpp + 2 * (((uint64_t)width + 254) / 255);
+    uint64_t alternating = ((2 * bpp + 3) * (uint64_t)width + 2 * bpp + 2) / 3;
+    return literals > alternating ? literals : alternating;
+}
+
+// Description: Choose the RLE compression for rows of a given width.
+// Params:
+// - width: pixels in each row
+// - bpp: bytes per pixel
+// Returns: AIF_COMPRESSION_RLE, or AIF_COMPRESSION_RLE_WIDE if a
+//          compressed row could be too long for a 2-byte length.
+int aif_rle_compression_for(uint32_t width, size_t bpp) {
+    if (worst_row_len(width, bpp) > UINT16_MAX) {
+        return AIF_COMPRESSION_RLE_WIDE;
+    }
+    return AIF_COMPRESSION_RLE;
+}
+
+// Description: Read the length prefix of a compressed row.
+// Params:
+// - p: pointer to the prefix
+// - prefix_size: bytes in the prefix (2 or 4)
+// Returns: compressed length of the row.
+static inline uint32_t read_row_len(const uint8_t *p, size_t prefix_size) {
+    if (prefix_size == 4) {
+        return read_le_u32(p);
+    }
+    return read_le_u16(p);
+}
+
+// Description: Write one compressed row preceded by its length.
+// Params:
+// - out: output writer
+// - comp: compressed row bytes
+// - comp_len: number of compressed bytes
+// - prefix_size: bytes in the length prefix (AIF_RLE_PREFIX_SIZE)
+// - index: row index to record the row in, or NULL
+// Returns: TRUE on success, FALSE on write failure.
+int aif_write_compressed_row(
+    struct aif_writer *out,
+    const uint8_t *comp,
+    size_t comp_len,
+    size_t prefix_size,
+    struct aif_row_index *index
+) {
+    if (index != NULL) {
+        aif_row_index_add(index, prefix_size + comp_len);
+    }
+
+    uint8_t len_bytes[4];
+    for (size_t i = 0; i < prefix_size; i++) {
+        len_bytes[i] = (comp_len >> (8 * i)) & 0xFF;
+    }
+
+    if (!aif_writer_write(out, len_bytes, prefix_size)) {
+        return FALSE;
+    }
+    return aif_writer_write(out, comp, comp_len);
+}
+
+// Description: Compress rows of pixels and write them, each preceded by
+//              its compressed length.
+// Params:
+// - out: output writer
+// - pixels: raw pixels of n_rows consecutive rows
+// - width: image width in pixels
+// - n_rows: number of rows to write
+// - bpp: bytes per pixel
+// - prefix_size: bytes in each length prefix (AIF_RLE_PREFIX_SIZE)
+// - buffer: scratch of at least AIF_RLE_MAX_ROW(width, bpp) bytes
+// - index: row index to record the rows in, or NULL
+// Returns: TRUE on success, FALSE on write failure.
+int aif_write_compressed_rows(
+    struct aif_writer *out,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t n_rows,
+    size_t bpp,
+    size_t prefix_size,
+    uint8_t *buffer,
+    struct aif_row_index *index
+) {
+    size_t row_bytes = (size_t)width * bpp;
+
+    for (uint32_t r = 0; r < n_rows; r++) {
+        const uint8_t *row = pixels + (size_t)r * row_bytes;
+        size_t comp_len = compress_row(row, width, bpp, buffer);
+
+        if (!aif_write_compressed_row(out, buffer, comp_len, prefix_size, index)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// Description: Decompress a repeat block starting at *cp.
+// Params:
+// - comp: compressed row data
+// - row_len: bytes in compressed row
+// - out_row: destination buffer
+// - row_bytes: expected output bytes for the row
+// - bpp: bytes per pixel
+// - cp: pointer to compressed cursor
+// - op: pointer to output cursor
+// - repeat_count: number of times to repeat pixel
+// Returns: TRUE on success, FALSE on invalid data/overflow.
+static int decompress_repeat_block(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint8_t *out_row,
+    size_t row_bytes,
+    size_t bpp,
+    size_t *cp,
+    size_t *op,
+    uint8_t repeat_count
+) {
+    if (*cp + bpp > row_len) {
+        return FALSE;
+    }
+
+    // Temporary buffer for a single pixel (max 3 bytes)
+    uint8_t pixel_buffer[3];
+    for (size_t k = 0; k < bpp; k++) {
+        pixel_buffer[k] = comp[*cp];
+        *cp = *cp + 1;
+    }
+
+    size_t required = (size_t)repeat_count * bpp;
+    if (*op + required > row_bytes) {
+        return FALSE;
+    }
+
+    for (uint8_t r = 0; r < repeat_count; r++) {
+        for (size_t k = 0; k < bpp; k++) {
+            out_row[*op] = pixel_buffer[k];
+            *op = *op + 1;
+        }
+    }
+
+    return TRUE;
+}
+
+// Description: Decompress a literal block starting at *cp.
+// Params:
+// - comp: compressed row data
+// - row_len: bytes in compressed row
+// - out_row: destination buffer
+// - row_bytes: expected output bytes for the row
+// - bpp: bytes per pixel
+// - cp: pointer to compressed cursor
+// - op: pointer to output cursor
+// Returns: TRUE on success, FALSE on invalid data/overflow.
+static int decompress_literal_block(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint8_t *out_row,
+    size_t row_bytes,
+    size_t bpp,
+    size_t *cp,
+    size_t *op
+) {
+    if (*cp >= row_len) {
+        return FALSE;
+    }
+
+    uint8_t literal_count = comp[*cp];
+    *cp = *cp + 1;
+
+    if (literal_count == 0) {
+        return FALSE;
+    }
+
+    size_t needed = (size_t)literal_count * bpp;
+    if (*cp + needed > row_len) {
+        return FALSE;
+    }
+    if (*op + needed > row_bytes) {
+        return FALSE;
+    }
+
+    // Literal pixels are stored exactly as they are output
+    memcpy(out_row + *op, comp + *cp, needed);
+    *op = *op + needed;
+    *cp = *cp + needed;
+
+    return TRUE;
+}
+
+// Description: Decompress one compressed row into output buffer.
+// Params:
+// - comp: compressed row bytes
+// - row_len: bytes in compressed row
+// - out_row: destination buffer
+// - row_bytes: expected output bytes for the row
+// - bpp: bytes per pixel
+// Returns: TRUE on success, FALSE on invalid data.
+int decompress_row(
+    const uint8_t *comp, 
+    uint32_t row_len, uint8_t 
+    *out_row, size_t row_bytes, 
+    size_t bpp
+) {
+    // index in compressed data
+    size_t cp = 0;
+
+    // index in output row
+    size_t op = 0;
+
+    while (op < row_bytes && cp < row_len) {
+        uint8_t tag = comp[cp];
+        cp = cp + 1;
+
+        int ok;
+        if (tag != 0) {
+            ok = decompress_repeat_block(comp, row_len, out_row,
+                                         row_bytes, bpp, &cp, &op, tag);
+        } else {
+            ok = decompress_literal_block(comp, row_len, out_row, 
+                                          row_bytes, bpp, &cp, &op);
+        }
+        if (!ok) {
+            return FALSE;
+        }
+    }
+
+    // After loop, row must be exactly filled
+    if (op != row_bytes) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Description: Decompress only some columns of a compressed row. Blocks
+//              before the span are skipped over without being expanded,
+//              and decoding stops once the span is filled, so the rest of
+//              the row is not looked at.
+// Params:
+// - comp: compressed row bytes
+// - row_len: bytes in compressed row
+// - width: pixels in the whole row
+// - bpp: bytes per pixel
+// - x: first column wanted
+// - n: number of columns wanted (x + n <= width)
+// - out: receives n pixels
+// Returns: TRUE on success, FALSE if the blocks up to the end of the span
+//          are malformed.
+int aif_rle_decode_span(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint32_t width,
+    size_t bpp,
+    uint32_t x,
+    uint32_t n,
+    uint8_t *out
+) {
+    size_t cp = 0;
+    uint32_t end = x + n;
+    // First pixel of the next block
+    uint32_t pixel = 0;
+
+    while (pixel < end && cp < row_len) {
+        uint8_t tag = comp[cp];
+        cp++;
+
+        uint32_t count;
+        const uint8_t *src = comp + cp;
+        if (tag != 0) {
+            count = tag;
+            if (cp + bpp > row_len) {
+                return FALSE;
+            }
+            cp += bpp;
+        } else {
+            if (cp >= row_len) {
+                return FALSE;
+            }
+            count = comp[cp];
+            cp++;
+            src++;
+            if (count == 0 || cp + (size_t)count * bpp > row_len) {
+                return FALSE;
+            }
+            cp += (size_t)count * bpp;
+        }
+        if (count > width - pixel) {
+            return FALSE;
+        }
+
+        // Copy the part of the block inside the span
+        uint32_t from = pixel > x ? pixel : x;
+        uint32_t to = pixel + count < end ? pixel + count : end;
+        if (from < to) {
+            uint8_t *dst = out + (size_t)(from - x) * bpp;
+            if (tag != 0) {
+                for (uint32_t i = 0; i < to - from; i++) {
+                    memcpy(dst + (size_t)i * bpp, src, bpp);
+                }
+            } else {
+                memcpy(dst, src + (size_t)(from - pixel) * bpp,
+                       (size_t)(to - from) * bpp);
+            }
+        }
+        pixel += count;
+    }
+
+    return pixel >= end;
+}
+
+// Description: Split a compressed row into its runs without expanding
+//              them: a repeat block becomes one run and each pixel of a
+//              literal block a run of one. Malformed rows are rejected
+//              exactly as by decompress_row.
+// Params:
+// - comp: compressed row bytes
+// - row_len: bytes in compressed row
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// - pixels: receives the pixel of each run (room for width pixels)
+// - counts: receives the length of each run (room for width entries)
+// - n_runs: receives the number of runs
+// Returns: TRUE on success, FALSE on invalid data.
+int aif_rle_row_runs(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint32_t width,
+    size_t bpp,
+    uint8_t *pixels,
+    uint8_t *counts,
+    uint32_t *n_runs
+) {
+    size_t cp = 0;
+    uint32_t n_pixels = 0;
+    uint32_t runs = 0;
+
+    while (n_pixels < width && cp < row_len) {
+        uint8_t tag = comp[cp];
+        cp++;
+
+        if (tag != 0) {
+            if (cp + bpp > row_len || tag > width - n_pixels) {
+                return FALSE;
+            }
+            memcpy(pixels + (size_t)runs * bpp, comp + cp, bpp);
+            counts[runs] = tag;
+            runs++;
+            cp += bpp;
+            n_pixels += tag;
+            continue;
+        }
+
+        if (cp >= row_len) {
+            return FALSE;
+        }
+        uint8_t literal_count = comp[cp];
+        cp++;
+        if (literal_count == 0
+            || cp + (size_t)literal_count * bpp > row_len
+            || literal_count > width - n_pixels) {
+            return FALSE;
+        }
+        memcpy(pixels + (size_t)runs * bpp, comp + cp, (size_t)literal_count * bpp);
+        memset(counts + runs, 1, literal_count);
+        runs += literal_count;
+        cp += (size_t)literal_count * bpp;
+        n_pixels += literal_count;
+    }
+
+    if (n_pixels != width) {
+        return FALSE;
+    }
+    *n_runs = runs;
+    return TRUE;
+}
+
+// Description: Read and decompress the next row of an RLE image.
+// Params:
+// - data: compressed image data (first row length prefix onwards)
+// - size: bytes available in data
+// - pos: cursor into data; advanced past the row
+// - prefix_size: bytes in each length prefix (AIF_RLE_PREFIX_SIZE)
+// - out_row: destination buffer
+// - row_bytes: expected output bytes for the row
+// - bpp: bytes per pixel
+// Returns: AIF_OK, AIF_ERR_EOF or AIF_ERR_CORRUPT.
+int aif_read_compressed_row(
+    const uint8_t *data,
+    size_t size,
+    size_t *pos,
+    size_t prefix_size,
+    uint8_t *out_row,
+    size_t row_bytes,
+    size_t bpp
+) {
+    // Read row length (little-endian)
+    if (size - *pos < prefix_size) {
+        return AIF_ERR_EOF;
+    }
+    uint32_t row_len = read_row_len(data + *pos, prefix_size);
+    *pos += prefix_size;
+
+    // Compressed row data is decoded in place
+    if (size - *pos < row_len) {
+        return AIF_ERR_EOF;
+    }
+    const uint8_t *comp = data + *pos;
+    *pos += row_len;
+
+    if (!decompress_row(comp, row_len, out_row, row_bytes, bpp)) {
+        return AIF_ERR_CORRUPT;
+    }
+    return AIF_OK;
+}
+
+// Description: Walk the length prefixes of the next rows of an RLE image
+//              without decoding them, so the rows can then be decoded
+//              independently.
+// Params:
+// - data: compressed image data (first row length prefix onwards)
+// - size: bytes available in data
+// - pos: cursor into data; advanced past every complete row found
+// - prefix_size: bytes in each length prefix (AIF_RLE_PREFIX_SIZE)
+// - n_rows: number of rows to look for
+// - offsets: receives the offset in data of each row's compressed bytes,
+//            or NULL when the rows are only being skipped
+// - lengths: receives the compressed length of each row, or NULL
+// Returns: number of complete rows found; less than n_rows only if the
+//          data ends early.
+uint32_t aif_scan_compressed_rows(
+    const uint8_t *data,
+    size_t size,
+    size_t *pos,
+    size_t prefix_size,
+    uint32_t n_rows,
+    size_t *offsets,
+    uint32_t *lengths
+) {
+    size_t p = *pos;
+    uint32_t i;
+    for (i = 0; i < n_rows; i++) {
+        if (size - p < prefix_size) {
+            break;
+        }
+        uint32_t row_len = read_row_len(data + p, prefix_size);
+        if (size - p - prefix_size < row_len) {
+            break;
+        }
+        if (offsets != NULL) {
+            offsets[i] = p + prefix_size;
+            lengths[i] = row_len;
+        }
+        p += prefix_size + (size_t)row_len;
+    }
+    *pos = p;
+    return i;
+}
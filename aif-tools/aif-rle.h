@@ -0,0 +1,114 @@
+#ifndef AIF_RLE_H
+#define AIF_RLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aif.h"
+#include "aif-index.h"
+#include "aif-io.h"
+
+// Size of a buffer that holds any compressed row (every pixel in a literal
+// block of its own); rows never actually get this long
+#define AIF_RLE_MAX_ROW(width, bpp) ((size_t)(width) * ((bpp) + 2))
+
+// Compressions storing RLE rows one after another, each behind a length
+// prefix: 2 bytes for AIF_COMPRESSION_RLE, 4 for AIF_COMPRESSION_RLE_WIDE
+// (for rows that may not fit in 65535 bytes)
+#define AIF_RLE_ROWS(compression) \
+    ((compression) == AIF_COMPRESSION_RLE || (compression) == AIF_COMPRESSION_RLE_WIDE)
+#define AIF_RLE_PREFIX_SIZE(compression) \
+    ((compression) == AIF_COMPRESSION_RLE_WIDE ? 4 : 2)
+
+// Returns the RLE compression whose row lengths fit rows of width pixels
+int aif_rle_compression_for(uint32_t width, size_t bpp);
+
+// Compresses one row into out; returns the number of bytes written
+size_t compress_row(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint8_t *out
+);
+// Decompresses one row; returns FALSE if the data is malformed
+int decompress_row(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint8_t *out_row,
+    size_t row_bytes,
+    size_t bpp
+);
+// Encodes a row given as runs (merging equal neighbours) exactly as
+// compress_row would encode the expanded row; returns bytes written
+size_t aif_rle_encode_runs(
+    const uint8_t *pixels,
+    const uint8_t *counts,
+    uint32_t n_runs,
+    size_t bpp,
+    uint8_t *out
+);
+// Writes one compressed row with its length prefix, recording it in
+// index unless that is NULL
+int aif_write_compressed_row(
+    struct aif_writer *out,
+    const uint8_t *comp,
+    size_t comp_len,
+    size_t prefix_size,
+    struct aif_row_index *index
+);
+// Compresses and writes n_rows rows with their length prefixes
+int aif_write_compressed_rows(
+    struct aif_writer *out,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t n_rows,
+    size_t bpp,
+    size_t prefix_size,
+    uint8_t *buffer,
+    struct aif_row_index *index
+);
+// Reads and decompresses the row at *pos, advancing *pos past it
+int aif_read_compressed_row(
+    const uint8_t *data,
+    size_t size,
+    size_t *pos,
+    size_t prefix_size,
+    uint8_t *out_row,
+    size_t row_bytes,
+    size_t bpp
+);
+// Decompresses columns x .. x + n - 1 of a row of width pixels, ignoring
+// the rest of the row; returns FALSE if the data is malformed
+int aif_rle_decode_span(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint32_t width,
+    size_t bpp,
+    uint32_t x,
+    uint32_t n,
+    uint8_t *out
+);
+// Splits a compressed row into runs without expanding them; returns FALSE
+// if the data is malformed
+int aif_rle_row_runs(
+    const uint8_t *comp,
+    uint32_t row_len,
+    uint32_t width,
+    size_t bpp,
+    uint8_t *pixels,
+    uint8_t *counts,
+    uint32_t *n_runs
+);
+// Finds the next n_rows rows at *pos without decoding them; returns the
+// number of complete rows found (offsets and lengths may be NULL)
+uint32_t aif_scan_compressed_rows(
+    const uint8_t *data,
+    size_t size,
+    size_t *pos,
+    size_t prefix_size,
+    uint32_t n_rows,
+    size_t *offsets,
+    uint32_t *lengths
+);
+
+#endif
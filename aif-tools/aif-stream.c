@@ -0,0 +1,685 @@
+// Description: Row-at-a-time image pipeline. Rows are decoded (or used in
+//              place when uncompressed), transformed and encoded in small
+//              batches, so no stage ever holds a whole image in memory.
+//              With more than one thread, the rows of a batch are
+//              located by a prescan of their length prefixes, then
+//              decoded, transformed and compressed on a thread pool and
+//              written out in order. When both sides are RLE and the
+//              operation (if any) works pixel by pixel, rows are never
+//              expanded: each run's pixel is transformed once, which may
+//              also change its size between RGB8 and GRAY8, and the runs
+//              are re-encoded, so the work is proportional to the
+//              compressed size rather than the pixel count. Passes to
+//              or from tiles go a band of rows at a time, with a task per
+//              tile.
+
+#include "aif.h"
+#include "aif-pool.h"
+#include "aif-rle.h"
+#include "aif-stream.h"
+#include "aif-tile.h"
+
+#include <stdlib.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Rows per batch for each thread when running in parallel
+#define ROWS_PER_THREAD 4
+// Parallel batches are grown to at least this many pixel bytes so that
+// narrow images still give each batch a useful amount of work
+#define MIN_BATCH_BYTES (256 << 10)
+// ...but the memory a batch takes up is kept below this
+#define MAX_BATCH_BYTES (4 << 20)
+// Row buffers are aligned to and padded out to whole cache lines
+#define CACHE_LINE 64
+
+// Buffers and results for one row of a batch
+struct stream_slot {
+    const uint8_t *comp_in;
+    uint32_t comp_in_len;
+    int status;
+    const uint8_t *in_row;
+    const uint8_t *out_row;
+    uint8_t *decoded;
+    uint8_t *run_counts;
+    uint8_t *transformed;
+    // Space in the output write buffer to transform into, if any
+    uint8_t *direct_out;
+    uint8_t *compressed;
+    size_t comp_len;
+};
+
+// Bytes of each row buffer of a slot
+struct stream_slot_sizes {
+    size_t decoded;
+    size_t run_counts;
+    size_t transformed;
+    size_t compressed;
+};
+
+struct stream_batch {
+    const struct aif_stream *s;
+    struct stream_slot *slots;
+    // Row offset table filled in by the prescan of each batch
+    size_t *offsets;
+    uint32_t *lengths;
+};
+
+// Description: Check whether a stream transforms compressed runs directly.
+// Params:
+// - s: stream description
+// Returns: TRUE for RLE to RLE passes with no operation or a per-pixel
+//          one.
+static int stream_on_runs(const struct aif_stream *s) {
+    return s->in_width == s->width
+           && AIF_RLE_ROWS(s->in_compression)
+           && AIF_RLE_ROWS(s->out_compression)
+           && (s->op == NULL || s->op_per_pixel);
+}
+
+// Description: Round a buffer size up to a whole number of cache lines.
+// Params:
+// - size: buffer size in bytes
+// Returns: rounded size.
+static size_t stream_line_round(size_t size) {
+    return (size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+// Description: Size the row buffers of a slot, each padded to whole cache
+//              lines.
+// Params:
+// - s: stream description
+// - sizes: filled in; 0 for buffers the pass does not need
+// Returns: void.
+static void stream_slot_sizes(const struct aif_stream *s, struct stream_slot_sizes *sizes) {
+    sizes->decoded = 0;
+    sizes->run_counts = 0;
+    sizes->transformed = 0;
+    sizes->compressed = 0;
+    if (AIF_RLE_ROWS(s->in_compression)) {
+        sizes->decoded = stream_line_round((size_t)s->width * s->in_bpp);
+    }
+    if (stream_on_runs(s)) {
+        sizes->run_counts = stream_line_round(s->width);
+    }
+    if (s->op != NULL) {
+        sizes->transformed = stream_line_round((size_t)s->width * s->out_bpp);
+    }
+    if (AIF_RLE_ROWS(s->out_compression)) {
+        sizes->compressed = stream_line_round(AIF_RLE_MAX_ROW(s->width, s->out_bpp));
+    }
+}
+
+// Description: Choose how many rows to process per batch.
+// Params:
+// - s: stream description
+// Returns: batch size in rows (1 when running on a single thread).
+static uint32_t stream_batch_rows(const struct aif_stream *s) {
+    if (s->n_threads <= 1) {
+        return 1;
+    }
+
+    size_t row_bytes = (size_t)s->width * s->in_bpp;
+    size_t rows = (size_t)s->n_threads * ROWS_PER_THREAD;
+    if (rows * row_bytes < MIN_BATCH_BYTES) {
+        rows = (MIN_BATCH_BYTES + row_bytes - 1) / row_bytes;
+    }
+
+    // Very narrow rows take far more memory than pixels, as each has its
+    // own slot, prescan entries and buffers padded to cache lines
+    struct stream_slot_sizes sizes;
+    stream_slot_sizes(s, &sizes);
+    size_t slot_bytes = sizes.decoded + sizes.run_counts + sizes.transformed
+                      + sizes.compressed + sizeof(struct stream_slot)
+                      + sizeof(size_t) + sizeof(uint32_t);
+    if (rows * slot_bytes > MAX_BATCH_BYTES) {
+        rows = MAX_BATCH_BYTES / slot_bytes;
+        if (rows < (size_t)s->n_threads * ROWS_PER_THREAD) {
+            rows = (size_t)s->n_threads * ROWS_PER_THREAD;
+        }
+    }
+    if (rows > s->height) {
+        rows = s->height;
+    }
+    return (uint32_t)rows;
+}
+
+// Description: Allocate the row buffers of every slot in a batch. All
+//              buffers are carved out of a single block, so a whole pass
+//              makes a fixed handful of allocations however many rows it
+//              processes, and each buffer starts on its own cache line so
+//              threads working on neighbouring slots never share one.
+// Params:
+// - s: stream description
+// - slots: zeroed slots to fill in
+// - n: number of slots
+// Returns: the block holding the buffers (to be freed by the
+//          caller), or NULL if out of memory.
+static uint8_t *stream_slots_alloc(
+    const struct aif_stream *s,
+    struct stream_slot *slots,
+    uint32_t n
+) {
+    struct stream_slot_sizes sizes;
+    stream_slot_sizes(s, &sizes);
+    size_t slot_bytes = sizes.decoded + sizes.run_counts + sizes.transformed
+                      + sizes.compressed;
+    uint8_t *block = aligned_alloc(CACHE_LINE, slot_bytes * n + CACHE_LINE);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    uint8_t *p = block;
+    for (uint32_t i = 0; i < n; i++) {
+        struct stream_slot *slot = &slots[i];
+        if (sizes.decoded > 0) {
+            slot->decoded = p;
+            p += sizes.decoded;
+        }
+        if (sizes.run_counts > 0) {
+            slot->run_counts = p;
+            p += sizes.run_counts;
+        }
+        if (sizes.transformed > 0) {
+            slot->transformed = p;
+            p += sizes.transformed;
+        }
+        if (sizes.compressed > 0) {
+            slot->compressed = p;
+            p += sizes.compressed;
+        }
+    }
+    return block;
+}
+
+// Description: Pool task; decode, transform and compress one row of a
+//              batch.
+// Params:
+// - ctx: stream_batch
+// - index: slot in the batch
+// Returns: void.
+static void stream_row_task(void *ctx, size_t index) {
+    struct stream_batch *batch = ctx;
+    const struct aif_stream *s = batch->s;
+    struct stream_slot *slot = &batch->slots[index];
+
+    // Transform the pixel of each run, then re-encode the runs
+    if (stream_on_runs(s)) {
+        uint32_t n_runs;
+        if (!aif_rle_row_runs(slot->comp_in, slot->comp_in_len, s->width,
+                              s->in_bpp, slot->decoded, slot->run_counts,
+                              &n_runs)) {
+            slot->status = AIF_ERR_CORRUPT;
+            return;
+        }
+        const uint8_t *run_pixels = slot->decoded;
+        if (s->op != NULL) {
+            s->op(s->op_ctx, slot->decoded, slot->transformed, n_runs);
+            run_pixels = slot->transformed;
+        }
+        slot->comp_len = aif_rle_encode_runs(run_pixels, slot->run_counts,
+                                             n_runs, s->out_bpp, slot->compressed);
+        slot->status = AIF_OK;
+        return;
+    }
+
+    // Decode
+    if (AIF_RLE_ROWS(s->in_compression)) {
+        int ok;
+        if (s->in_width == s->width) {
+            ok = decompress_row(slot->comp_in, slot->comp_in_len, slot->decoded,
+                                (size_t)s->width * s->in_bpp, s->in_bpp);
+        } else {
+            ok = aif_rle_decode_span(slot->comp_in, slot->comp_in_len,
+                                     s->in_width, s->in_bpp, s->in_x,
+                                     s->width, slot->decoded);
+        }
+        if (!ok) {
+            slot->status = AIF_ERR_CORRUPT;
+            return;
+        }
+        slot->in_row = slot->decoded;
+    }
+    slot->status = AIF_OK;
+
+    // Transform
+    slot->out_row = slot->in_row;
+    if (s->op != NULL) {
+        uint8_t *dst = slot->direct_out != NULL ? slot->direct_out
+                                                : slot->transformed;
+        s->op(s->op_ctx, slot->in_row, dst, s->width);
+        slot->out_row = dst;
+    }
+
+    // Encode
+    if (AIF_RLE_ROWS(s->out_compression)) {
+        slot->comp_len = compress_row(slot->out_row, s->width, s->out_bpp,
+                                      slot->compressed);
+    }
+}
+
+// A band of rows of a pass to or from tiles
+struct tile_band {
+    const struct aif_stream *s;
+    // First output row of the band and the number of rows in it
+    uint32_t row;
+    uint32_t n_rows;
+    // Input rows, pointing into the input or into decoded
+    const uint8_t **in_rows;
+    uint8_t *decoded;
+    // Compressed rows of an RLE input
+    size_t *comp_offsets;
+    uint32_t *comp_lens;
+    // Output rows, when the output is not tiled
+    const uint8_t **out_rows;
+    // Output tile width, or 0 when the output is not tiled
+    uint32_t tile_width;
+    // Per task: transformed pixels and encoded output
+    uint8_t *transformed;
+    size_t transformed_bytes;
+    uint8_t *encoded;
+    size_t encoded_bytes;
+    size_t *encoded_len;
+    int *status;
+};
+
+// Description: Pool task; decode one input tile column, or one RLE row,
+//              of a band.
+// Params:
+// - ctx: tile_band
+// - index: tile column counted from the first one used, or row of the
+//          band
+// Returns: void; the result is left in status[index].
+static void tile_decode_task(void *ctx, size_t index) {
+    struct tile_band *band = ctx;
+    const struct aif_stream *s = band->s;
+    size_t row_bytes = (size_t)s->width * s->in_bpp;
+
+    if (AIF_RLE_ROWS(s->in_compression)) {
+        int ok;
+        uint8_t *row = band->decoded + index * row_bytes;
+        if (s->in_width == s->width) {
+            ok = decompress_row(s->in_data + band->comp_offsets[index],
+                                band->comp_lens[index], row, row_bytes, s->in_bpp);
+        } else {
+            ok = aif_rle_decode_span(s->in_data + band->comp_offsets[index],
+                                     band->comp_lens[index],
+                                     s->in_width, s->in_bpp, s->in_x, s->width, row);
+        }
+        band->status[index] = ok ? AIF_OK : AIF_ERR_CORRUPT;
+        return;
+    }
+
+    // Columns of this tile column inside the used part of the input
+    uint32_t tile_width = s->in_tiles->tile_width;
+    uint32_t left = (s->in_x / tile_width + index) * tile_width;
+    uint32_t from = left > s->in_x ? left : s->in_x;
+    uint32_t to = s->in_x + s->width;
+    if (to - left > tile_width) {
+        to = left + tile_width;
+    }
+    uint8_t *dst = band->decoded + (size_t)(from - s->in_x) * s->in_bpp;
+    band->status[index] = aif_tile_decode_region(s->in_tiles, s->in_bpp, from,
+                                                 s->in_y + band->row, to - from,
+                                                 band->n_rows, dst, row_bytes);
+}
+
+// Description: Pool task; transform and encode one output tile column,
+//              or one output row, of a band.
+// Params:
+// - ctx: tile_band
+// - index: output tile column, or row of the band
+// Returns: void.
+static void tile_encode_task(void *ctx, size_t index) {
+    struct tile_band *band = ctx;
+    const struct aif_stream *s = band->s;
+    uint8_t *transformed = band->transformed + index * band->transformed_bytes;
+    uint8_t *encoded = band->encoded + index * band->encoded_bytes;
+
+    if (band->tile_width == 0) {
+        const uint8_t *row = band->in_rows[index];
+        if (s->op != NULL) {
+            s->op(s->op_ctx, row, transformed, s->width);
+            row = transformed;
+        }
+        band->out_rows[index] = row;
+        if (AIF_RLE_ROWS(s->out_compression)) {
+            band->encoded_len[index] = compress_row(row, s->width, s->out_bpp,
+                                                    encoded);
+        }
+        return;
+    }
+
+    uint32_t left = index * band->tile_width;
+    uint32_t width = s->width - left;
+    if (width > band->tile_width) {
+        width = band->tile_width;
+    }
+    size_t len = 0;
+    for (uint32_t r = 0; r < band->n_rows; r++) {
+        const uint8_t *row = band->in_rows[r] + (size_t)left * s->in_bpp;
+        if (s->op != NULL) {
+            s->op(s->op_ctx, row, transformed, width);
+            row = transformed;
+        }
+        len += aif_tile_encode_rows(row, 0, width, 1, s->out_bpp, encoded + len);
+    }
+    band->encoded_len[index] = len;
+}
+
+// Description: Stream an image whose input or output is tiled. Rows are
+//              taken a band at a time, one tile high (or less, when only
+//              the input is tiled): the band is decoded
+//              with a task per input tile column (or RLE row), then
+//              transformed and encoded with a task per output tile column
+//              (or row), and written in order.
+// Params:
+// - s: description of the input, the row operation and the output
+// Returns: AIF_OK on success, otherwise an AIF_ERR_* code.
+static int stream_tiles(const struct aif_stream *s) {
+    size_t in_row_bytes = (size_t)s->in_width * s->in_bpp;
+    size_t row_bytes = (size_t)s->width * s->in_bpp;
+    int tiled_out = s->out_compression == AIF_COMPRESSION_TILED;
+
+    struct aif_tile_table table = { 0 };
+    uint32_t band_rows;
+    if (tiled_out) {
+        if (!aif_tile_table_init(&table, s->width, s->height)) {
+            return AIF_ERR_NO_MEMORY;
+        }
+        band_rows = table.tile_height;
+    } else {
+        // Only part of each tile is decoded at a time, keeping the band
+        // small enough to stay in cache until its rows are written
+        band_rows = s->in_tiles->tile_height;
+        if ((size_t)band_rows * row_bytes > MIN_BATCH_BYTES) {
+            band_rows = MIN_BATCH_BYTES / row_bytes;
+        }
+        if (band_rows == 0) {
+            band_rows = 1;
+        }
+    }
+    if (band_rows > s->height) {
+        band_rows = s->height;
+    }
+
+    // Tasks of each step: input tile columns (or rows) to decode, then
+    // output tile columns (or rows) to encode
+    size_t n_decode = band_rows;
+    if (s->in_compression == AIF_COMPRESSION_TILED) {
+        uint32_t tile_width = s->in_tiles->tile_width;
+        n_decode = (s->in_x + s->width - 1) / tile_width - s->in_x / tile_width + 1;
+    }
+    struct tile_band band = { .s = s };
+    size_t n_encode = band_rows;
+    band.transformed_bytes = stream_line_round((size_t)s->width * s->out_bpp);
+    band.encoded_bytes = stream_line_round(AIF_RLE_MAX_ROW(s->width, s->out_bpp));
+    if (tiled_out) {
+        band.tile_width = table.tile_width;
+        n_encode = (s->width - 1) / table.tile_width + 1;
+        band.transformed_bytes = stream_line_round((size_t)table.tile_width * s->out_bpp);
+        band.encoded_bytes = stream_line_round(AIF_TILE_MAX_BYTES(table.tile_width,
+                                                                  band_rows, s->out_bpp));
+    }
+    if (s->op == NULL) {
+        band.transformed_bytes = 0;
+    }
+    if (s->out_compression == AIF_COMPRESSION_NONE) {
+        band.encoded_bytes = 0;
+    }
+
+    size_t n_status = n_decode > n_encode ? n_decode : n_encode;
+    band.in_rows = malloc(band_rows * sizeof(*band.in_rows));
+    band.out_rows = malloc(band_rows * sizeof(*band.out_rows));
+    band.comp_offsets = malloc(band_rows * sizeof(*band.comp_offsets));
+    band.comp_lens = malloc(band_rows * sizeof(*band.comp_lens));
+    band.encoded_len = malloc(n_encode * sizeof(*band.encoded_len));
+    band.status = malloc(n_status * sizeof(*band.status));
+    if (s->in_compression != AIF_COMPRESSION_NONE) {
+        band.decoded = malloc(band_rows * row_bytes);
+    }
+    band.transformed = malloc(n_encode * band.transformed_bytes + 1);
+    band.encoded = malloc(n_encode * band.encoded_bytes + 1);
+    struct aif_pool *pool = NULL;
+
+    int status = AIF_OK;
+    if (band.in_rows == NULL || band.out_rows == NULL || band.comp_offsets == NULL
+        || band.comp_lens == NULL || band.encoded_len == NULL
+        || band.status == NULL || band.transformed == NULL || band.encoded == NULL
+        || (s->in_compression != AIF_COMPRESSION_NONE && band.decoded == NULL)) {
+        status = AIF_ERR_NO_MEMORY;
+    } else if (s->n_threads > 1) {
+        pool = aif_pool_create(s->n_threads);
+        if (pool == NULL) {
+            status = AIF_ERR_NO_MEMORY;
+        }
+    }
+    if (status == AIF_OK && tiled_out && !aif_tile_table_start(s->out, &table)) {
+        status = AIF_ERR_WRITE;
+    }
+
+    size_t pos = 0;
+    for (uint32_t row = 0; status == AIF_OK && row < s->height; row += band_rows) {
+        uint32_t n = band_rows;
+        if (n > s->height - row) {
+            n = s->height - row;
+        }
+        band.row = row;
+        band.n_rows = n;
+
+        // Locate the input rows, then decode them
+        size_t n_tasks = n_decode;
+        if (s->in_compression == AIF_COMPRESSION_NONE) {
+            n_tasks = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                if (s->in_size - pos < in_row_bytes) {
+                    status = AIF_ERR_EOF;
+                    break;
+                }
+                band.in_rows[i] = s->in_data + pos + (size_t)s->in_x * s->in_bpp;
+                pos += in_row_bytes;
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                band.in_rows[i] = band.decoded + i * row_bytes;
+            }
+        }
+        if (AIF_RLE_ROWS(s->in_compression)) {
+            n_tasks = aif_scan_compressed_rows(s->in_data, s->in_size, &pos,
+                                               AIF_RLE_PREFIX_SIZE(s->in_compression),
+                                               n, band.comp_offsets, band.comp_lens);
+            if (n_tasks < n) {
+                status = AIF_ERR_EOF;
+            }
+        }
+        if (pool != NULL) {
+            aif_pool_run(pool, n_tasks, tile_decode_task, &band);
+        } else {
+            for (size_t i = 0; i < n_tasks; i++) {
+                tile_decode_task(&band, i);
+            }
+        }
+        // Report the first bad row or tile, as a serial decoder would
+        int decode_status = AIF_OK;
+        for (size_t i = 0; decode_status == AIF_OK && i < n_tasks; i++) {
+            decode_status = band.status[i];
+        }
+        if (decode_status != AIF_OK) {
+            status = decode_status;
+        }
+        if (status != AIF_OK) {
+            break;
+        }
+
+        // Transform and encode
+        n_tasks = tiled_out ? n_encode : n;
+        if (pool != NULL) {
+            aif_pool_run(pool, n_tasks, tile_encode_task, &band);
+        } else {
+            for (size_t i = 0; i < n_tasks; i++) {
+                tile_encode_task(&band, i);
+            }
+        }
+
+        // Write in order
+        for (size_t i = 0; status == AIF_OK && i < n_tasks; i++) {
+            const uint8_t *encoded = band.encoded + i * band.encoded_bytes;
+            int ok;
+            if (tiled_out) {
+                ok = aif_tile_write(s->out, &table, encoded, band.encoded_len[i]);
+            } else if (AIF_RLE_ROWS(s->out_compression)) {
+                ok = aif_write_compressed_row(s->out, encoded, band.encoded_len[i],
+                                              AIF_RLE_PREFIX_SIZE(s->out_compression),
+                                              s->out_index);
+            } else {
+                ok = aif_writer_write(s->out, band.out_rows[i],
+                                      (size_t)s->width * s->out_bpp);
+            }
+            if (!ok) {
+                status = AIF_ERR_WRITE;
+            }
+        }
+    }
+    if (status == AIF_OK && tiled_out && !aif_tile_table_write(s->out, &table)) {
+        status = AIF_ERR_WRITE;
+    }
+
+    aif_pool_destroy(pool);
+    aif_tile_table_free(&table);
+    free(band.in_rows);
+    free(band.out_rows);
+    free(band.comp_offsets);
+    free(band.comp_lens);
+    free(band.encoded_len);
+    free(band.status);
+    free(band.decoded);
+    free(band.transformed);
+    free(band.encoded);
+    return status;
+}
+
+// Description: Stream every row of an image from input to output.
+// Params:
+// - s: description of the input, the row operation and the output
+// Returns: AIF_OK on success, otherwise an AIF_ERR_* code.
+int aif_stream_image(const struct aif_stream *s) {
+    if (s->in_compression == AIF_COMPRESSION_TILED
+        || s->out_compression == AIF_COMPRESSION_TILED) {
+        return stream_tiles(s);
+    }
+
+    size_t in_row_bytes = (size_t)s->in_width * s->in_bpp;
+    size_t out_row_bytes = (size_t)s->width * s->out_bpp;
+
+    // Small ring of row slots, each with buffers for the decoded input,
+    // transformed output and compressed output as the pass needs them
+    uint32_t batch_rows = stream_batch_rows(s);
+    struct stream_slot *slots = calloc(batch_rows, sizeof(*slots));
+    size_t *offsets = malloc(batch_rows * sizeof(*offsets));
+    uint32_t *lengths = malloc(batch_rows * sizeof(*lengths));
+    uint8_t *buffers = NULL;
+    struct aif_pool *pool = NULL;
+
+    int status = AIF_OK;
+    if (slots != NULL) {
+        buffers = stream_slots_alloc(s, slots, batch_rows);
+    }
+    if (buffers == NULL || offsets == NULL || lengths == NULL) {
+        status = AIF_ERR_NO_MEMORY;
+    } else if (batch_rows > 1) {
+        pool = aif_pool_create(s->n_threads);
+        if (pool == NULL) {
+            status = AIF_ERR_NO_MEMORY;
+        }
+    }
+
+    struct stream_batch batch = { s, slots, offsets, lengths };
+    size_t pos = 0;
+    for (uint32_t row = 0; status == AIF_OK && row < s->height; row += batch_rows) {
+        uint32_t n = batch_rows;
+        if (n > s->height - row) {
+            n = s->height - row;
+        }
+
+        // Locate the input rows; compressed rows are only found here and
+        // are decoded by the row tasks
+        uint32_t n_found = n;
+        if (AIF_RLE_ROWS(s->in_compression)) {
+            n_found = aif_scan_compressed_rows(s->in_data, s->in_size, &pos,
+                                               AIF_RLE_PREFIX_SIZE(s->in_compression),
+                                               n, offsets, lengths);
+            for (uint32_t i = 0; i < n_found; i++) {
+                slots[i].comp_in = s->in_data + offsets[i];
+                slots[i].comp_in_len = lengths[i];
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                if (s->in_size - pos < in_row_bytes) {
+                    n_found = i;
+                    break;
+                }
+                slots[i].in_row = s->in_data + pos + (size_t)s->in_x * s->in_bpp;
+                pos += in_row_bytes;
+            }
+        }
+
+        // Uncompressed output of a row operation is produced straight
+        // into the write buffer when the whole batch fits there
+        uint8_t *direct = NULL;
+        if (s->op != NULL && s->out_compression == AIF_COMPRESSION_NONE) {
+            direct = aif_writer_reserve(s->out, n * out_row_bytes);
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            slots[i].direct_out = direct != NULL ? direct + i * out_row_bytes : NULL;
+        }
+
+        // Decode, transform and encode
+        if (pool != NULL) {
+            aif_pool_run(pool, n_found, stream_row_task, &batch);
+        } else {
+            for (uint32_t i = 0; i < n_found; i++) {
+                stream_row_task(&batch, i);
+            }
+        }
+
+        // Report the first bad row, as a row-by-row decoder would
+        for (uint32_t i = 0; status == AIF_OK && i < n_found; i++) {
+            status = slots[i].status;
+        }
+        if (status == AIF_OK && n_found < n) {
+            status = AIF_ERR_EOF;
+        }
+        if (status != AIF_OK) {
+            break;
+        }
+
+        // Write in row order
+        if (direct != NULL) {
+            aif_writer_commit(s->out, n * out_row_bytes);
+            continue;
+        }
+        for (uint32_t i = 0; status == AIF_OK && i < n; i++) {
+            struct stream_slot *slot = &slots[i];
+            int ok;
+            if (AIF_RLE_ROWS(s->out_compression)) {
+                ok = aif_write_compressed_row(s->out, slot->compressed,
+                                              slot->comp_len,
+                                              AIF_RLE_PREFIX_SIZE(s->out_compression),
+                                              s->out_index);
+            } else {
+                ok = aif_writer_write(s->out, slot->out_row, out_row_bytes);
+            }
+            if (!ok) {
+                status = AIF_ERR_WRITE;
+            }
+        }
+    }
+
+    aif_pool_destroy(pool);
+    free(buffers);
+    free(slots);
+    free(offsets);
+    free(lengths);
+    return status;
+}
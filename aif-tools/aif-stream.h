@@ -0,0 +1,59 @@
+#ifndef AIF_STREAM_H
+#define AIF_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aif-index.h"
+#include "aif-io.h"
+#include "aif-tile.h"
+
+// Per-pixel operation applied to one row; reads width pixels from in and
+// writes width pixels to out (which never aliases in)
+typedef void (*aif_row_op)(void *ctx, const uint8_t *in, uint8_t *out, uint32_t width);
+
+// Description of one pass over an image: rows are decoded from the input,
+// passed through op and encoded to the output a few at a time, so memory
+// use is proportional to the width of the image rather than its size.
+struct aif_stream {
+    // Pixel data following the input header
+    const uint8_t *in_data;
+    size_t in_size;
+    int in_compression;
+    size_t in_bpp;
+    // Pixels in each input row, of which width pixels from column in_x
+    // on are used (in_x = 0 and in_width = width for whole rows)
+    uint32_t in_width;
+    uint32_t in_x;
+    // Tiles of a tiled input and the first of their rows used; other
+    // inputs start in_data at the first row used
+    const struct aif_tile_view *in_tiles;
+    uint32_t in_y;
+    uint32_t width;
+    uint32_t height;
+
+    // Row operation; NULL passes rows through unchanged
+    aif_row_op op;
+    void *op_ctx;
+    // Set when op maps each pixel on its own, regardless of its
+    // neighbours; RLE to RLE passes then transform each run once instead
+    // of decoding and recompressing the row (as they always do without
+    // an op)
+    int op_per_pixel;
+    size_t out_bpp;
+
+    // Output with its header already written; tiled output is written
+    // from the tile size on, offset table included
+    struct aif_writer *out;
+    int out_compression;
+    // Index to record compressed output rows in, or NULL
+    struct aif_row_index *out_index;
+
+    // Threads used to decode, transform and compress rows
+    int n_threads;
+};
+
+// Streams every row of the image; returns AIF_OK or an AIF_ERR_* code
+int aif_stream_image(const struct aif_stream *s);
+
+#endif
@@ -0,0 +1,342 @@
+// Description: Tiled pixel data. Tiles are compressed independently, so
+//              they can be encoded and decoded on any number of threads
+//              and a region is read by decoding only the tiles under it.
+//              The offset table goes after the last tile, as tiles are
+//              only sized once compressed, and a reader checks it
+//              thoroughly before using it.
+
+#include "aif.h"
+#include "aif-io.h"
+#include "aif-rle.h"
+#include "aif-tile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Description: Store a 32-bit value little-endian.
+// Params:
+// - buf: destination
+// - value: value to store
+// Returns: void.
+static void put_le_u32(uint8_t *buf, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+// Description: Store a 64-bit value little-endian.
+// Params:
+// - buf: destination
+// - value: value to store
+// Returns: void.
+static void put_le_u64(uint8_t *buf, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+// Description: Number of tiles needed to cover a dimension.
+// Params:
+// - n: pixels along the dimension (> 0)
+// - tile: tile size along it (> 0)
+// Returns: tile count.
+static uint32_t tile_count(uint32_t n, uint32_t tile) {
+    return (n - 1) / tile + 1;
+}
+
+// Description: Prepare to collect the tile offsets of an image.
+// Params:
+// - table: table to set up
+// - width: image width in pixels (> 0)
+// - height: image height in pixels (> 0)
+// Returns: TRUE on success, FALSE if out of memory (or the image has
+//          more tiles than the table can count).
+int aif_tile_table_init(struct aif_tile_table *table, uint32_t width, uint32_t height) {
+    table->tile_width = AIF_TILE_SIZE;
+    table->tile_height = AIF_TILE_SIZE;
+    uint64_t n_tiles = (uint64_t)tile_count(width, table->tile_width)
+                     * tile_count(height, table->tile_height);
+    table->offsets = NULL;
+    if (n_tiles > UINT32_MAX) {
+        return FALSE;
+    }
+    table->n_tiles = n_tiles;
+    table->n_added = 0;
+    table->pos = AIF_TILE_HEADER_SIZE;
+    table->offsets = malloc(table->n_tiles * sizeof(*table->offsets));
+    return table->offsets != NULL;
+}
+
+// Description: Write the tile size at the start of the pixel data.
+// Params:
+// - out: output positioned just after the header
+// - table: table set up by aif_tile_table_init
+// Returns: TRUE on success, FALSE on write failure.
+int aif_tile_table_start(struct aif_writer *out, const struct aif_tile_table *table) {
+    uint8_t header[AIF_TILE_HEADER_SIZE];
+    put_le_u32(header, table->tile_width);
+    put_le_u32(header + 4, table->tile_height);
+    return aif_writer_write(out, header, sizeof(header));
+}
+
+// Description: Write the next tile and record where it starts.
+// Params:
+// - out: output writer
+// - table: table being collected
+// - tile: encoded tile
+// - len: bytes in tile
+// Returns: TRUE on success, FALSE on write failure.
+int aif_tile_write(
+    struct aif_writer *out,
+    struct aif_tile_table *table,
+    const uint8_t *tile,
+    size_t len
+) {
+    table->offsets[table->n_added] = table->pos;
+    table->n_added++;
+    table->pos += len;
+    return aif_writer_write(out, tile, len);
+}
+
+// Description: Append the offset table after the last tile.
+// Params:
+// - out: output positioned just after the last tile
+// - table: table with every tile written
+// Returns: TRUE on success, FALSE on write failure.
+int aif_tile_table_write(struct aif_writer *out, const struct aif_tile_table *table) {
+    uint8_t entry[AIF_TILE_ENTRY_SIZE];
+    for (size_t i = 0; i < table->n_tiles; i++) {
+        put_le_u64(entry, table->offsets[i]);
+        if (!aif_writer_write(out, entry, sizeof(entry))) {
+            return FALSE;
+        }
+    }
+
+    uint8_t footer[AIF_TILE_FOOTER_SIZE];
+    put_le_u32(footer, table->n_tiles);
+    memcpy(footer + 4, AIF_TILE_MAGIC, AIF_TILE_MAGIC_SIZE);
+    return aif_writer_write(out, footer, sizeof(footer));
+}
+
+// Description: Free a collected table.
+// Params:
+// - table: table set up by aif_tile_table_init
+// Returns: void.
+void aif_tile_table_free(struct aif_tile_table *table) {
+    free(table->offsets);
+    table->offsets = NULL;
+}
+
+// Description: Compress rows of a tile, each preceded by its 2-byte
+//              compressed length.
+// Params:
+// - pixels: first pixel of the first row
+// - stride: bytes from one row to the next
+// - width: pixels in each row
+// - n_rows: number of rows
+// - bpp: bytes per pixel
+// - out: at least AIF_TILE_MAX_BYTES(width, n_rows, bpp) bytes
+// Returns: number of bytes written.
+size_t aif_tile_encode_rows(
+    const uint8_t *pixels,
+    size_t stride,
+    uint32_t width,
+    uint32_t n_rows,
+    size_t bpp,
+    uint8_t *out
+) {
+    size_t len = 0;
+    for (uint32_t r = 0; r < n_rows; r++) {
+        size_t comp_len = compress_row(pixels + r * stride, width, bpp, out + len + 2);
+        out[len] = comp_len & 0xFF;
+        out[len + 1] = (comp_len >> 8) & 0xFF;
+        len += 2 + comp_len;
+    }
+    return len;
+}
+
+// Description: Read one entry of the offset table.
+// Params:
+// - view: tiles found by aif_tile_find
+// - tile: tile number
+// Returns: offset of the tile from the start of pixel data.
+static uint64_t tile_offset(const struct aif_tile_view *view, size_t tile) {
+    const uint8_t *p = view->entries + tile * AIF_TILE_ENTRY_SIZE;
+    return (uint64_t)read_le_u32(p) | ((uint64_t)read_le_u32(p + 4) << 32);
+}
+
+// Description: Find the tiles of a tiled image. The table is only
+//              accepted if it has one entry per tile of the image, the
+//              first tile starts right after the tile size and the rest
+//              rise strictly through the tile data before the table.
+// Params:
+// - data: pixel data (tile size onwards)
+// - size: bytes of pixel data, table included
+// - width: image width in pixels (> 0)
+// - height: image height in pixels (> 0)
+// - view: filled in if the tiles are valid
+// Returns: TRUE if a valid tile size and table were found, otherwise FALSE.
+int aif_tile_find(
+    const uint8_t *data,
+    size_t size,
+    uint32_t width,
+    uint32_t height,
+    struct aif_tile_view *view
+) {
+    if (size < AIF_TILE_HEADER_SIZE + AIF_TILE_FOOTER_SIZE) {
+        return FALSE;
+    }
+    const uint8_t *footer = data + size - AIF_TILE_FOOTER_SIZE;
+    if (memcmp(footer + 4, AIF_TILE_MAGIC, AIF_TILE_MAGIC_SIZE) != 0) {
+        return FALSE;
+    }
+
+    view->data = data;
+    view->width = width;
+    view->height = height;
+    view->tile_width = read_le_u32(data);
+    view->tile_height = read_le_u32(data + 4);
+    if (view->tile_width == 0 || view->tile_height == 0) {
+        return FALSE;
+    }
+    view->tiles_x = tile_count(width, view->tile_width);
+    view->tiles_y = tile_count(height, view->tile_height);
+
+    uint64_t n_tiles = (uint64_t)view->tiles_x * view->tiles_y;
+    if (read_le_u32(footer) != n_tiles) {
+        return FALSE;
+    }
+    size_t entry_space = size - AIF_TILE_HEADER_SIZE - AIF_TILE_FOOTER_SIZE;
+    if (entry_space / AIF_TILE_ENTRY_SIZE < n_tiles) {
+        return FALSE;
+    }
+    view->tiles_end = size - AIF_TILE_FOOTER_SIZE - n_tiles * AIF_TILE_ENTRY_SIZE;
+    view->entries = data + view->tiles_end;
+
+    for (size_t i = 0; i < n_tiles; i++) {
+        uint64_t offset = tile_offset(view, i);
+        if (i == 0 ? offset != AIF_TILE_HEADER_SIZE
+                   : offset <= tile_offset(view, i - 1)) {
+            return FALSE;
+        }
+        if (offset >= view->tiles_end) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Description: Decode part of one tile. Rows above the part are skipped
+//              by their length prefixes, and the columns are decoded as a
+//              span unless the part is the full width of the tile.
+// Params:
+// - view: tiles found by aif_tile_find
+// - tx: tile column
+// - ty: tile row
+// - bpp: bytes per pixel
+// - x: first column within the tile
+// - y: first row within the tile
+// - n: number of columns (inside the tile)
+// - n_rows: number of rows (inside the tile)
+// - out: receives n_rows rows of n pixels
+// - stride: bytes from one row of out to the next
+// Returns: AIF_OK or AIF_ERR_CORRUPT.
+int aif_tile_decode(
+    const struct aif_tile_view *view,
+    uint32_t tx,
+    uint32_t ty,
+    size_t bpp,
+    uint32_t x,
+    uint32_t y,
+    uint32_t n,
+    uint32_t n_rows,
+    uint8_t *out,
+    size_t stride
+) {
+    size_t tile = (size_t)ty * view->tiles_x + tx;
+    uint64_t start = tile_offset(view, tile);
+    uint64_t end = view->tiles_end;
+    if (tile + 1 < (size_t)view->tiles_x * view->tiles_y) {
+        end = tile_offset(view, tile + 1);
+    }
+    const uint8_t *data = view->data + start;
+    size_t size = end - start;
+
+    uint32_t tile_width = view->width - tx * view->tile_width;
+    if (tile_width > view->tile_width) {
+        tile_width = view->tile_width;
+    }
+
+    size_t pos = 0;
+    if (aif_scan_compressed_rows(data, size, &pos, 2, y, NULL, NULL) < y) {
+        return AIF_ERR_CORRUPT;
+    }
+    for (uint32_t r = 0; r < n_rows; r++) {
+        size_t offset;
+        uint32_t length;
+        if (aif_scan_compressed_rows(data, size, &pos, 2, 1, &offset, &length) < 1) {
+            return AIF_ERR_CORRUPT;
+        }
+        uint8_t *row = out + r * stride;
+        int ok;
+        if (x == 0 && n == tile_width) {
+            ok = decompress_row(data + offset, length, row, (size_t)n * bpp, bpp);
+        } else {
+            ok = aif_rle_decode_span(data + offset, length, tile_width, bpp,
+                                     x, n, row);
+        }
+        if (!ok) {
+            return AIF_ERR_CORRUPT;
+        }
+    }
+    return AIF_OK;
+}
+
+// Description: Decode a rectangle of a tiled image, one covering tile at
+//              a time.
+// Params:
+// - view: tiles found by aif_tile_find
+// - bpp: bytes per pixel
+// - x: first column
+// - y: first row
+// - width: columns wanted (inside the image)
+// - height: rows wanted (inside the image)
+// - out: receives height rows of width pixels
+// - stride: bytes from one row of out to the next
+// Returns: AIF_OK or AIF_ERR_CORRUPT.
+int aif_tile_decode_region(
+    const struct aif_tile_view *view,
+    size_t bpp,
+    uint32_t x,
+    uint32_t y,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out,
+    size_t stride
+) {
+    uint32_t tw = view->tile_width;
+    uint32_t th = view->tile_height;
+    for (uint32_t ty = y / th; ty <= (y + height - 1) / th; ty++) {
+        uint32_t top = ty * th;
+        uint32_t r0 = y > top ? y - top : 0;
+        uint32_t r1 = y + height - top < th ? y + height - top : th;
+
+        for (uint32_t tx = x / tw; tx <= (x + width - 1) / tw; tx++) {
+            uint32_t left = tx * tw;
+            uint32_t c0 = x > left ? x - left : 0;
+            uint32_t c1 = x + width - left < tw ? x + width - left : tw;
+
+            uint8_t *dst = out + (size_t)(top + r0 - y) * stride
+                         + (size_t)(left + c0 - x) * bpp;
+            int status = aif_tile_decode(view, tx, ty, bpp, c0, r0,
+                                         c1 - c0, r1 - r0, dst, stride);
+            if (status != AIF_OK) {
+                return status;
+            }
+        }
+    }
+    return AIF_OK;
+}
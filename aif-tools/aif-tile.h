@@ -0,0 +1,124 @@
+#ifndef AIF_TILE_H
+#define AIF_TILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aif-io.h"
+#include "aif-rle.h"
+
+// Pixel data of a tiled image (AIF_COMPRESSION_TILED). The image is cut
+// into tiles of tile_width x tile_height pixels (smaller along the right
+// and bottom edges), stored left to right, top to bottom. Each tile holds
+// its rows RLE-compressed as in AIF_COMPRESSION_RLE, but only as wide as
+// the tile, so every tile can be decoded on its own. Layout, all
+// little-endian:
+//   u32 tile_width
+//   u32 tile_height
+//   tiles
+//   u64 offset[n_tiles]  from the start of pixel data to each tile
+//   u32 n_tiles
+//   "AIFTILES"
+#define AIF_TILE_SIZE 256
+#define AIF_TILE_HEADER_SIZE 8
+#define AIF_TILE_MAGIC "AIFTILES"
+#define AIF_TILE_MAGIC_SIZE 8
+#define AIF_TILE_ENTRY_SIZE 8
+#define AIF_TILE_FOOTER_SIZE (4 + AIF_TILE_MAGIC_SIZE)
+
+// Worst-case compressed size of one tile, length prefixes included
+#define AIF_TILE_MAX_BYTES(width, height, bpp) \
+    ((size_t)(height) * (2 + AIF_RLE_MAX_ROW(width, bpp)))
+
+// Tile offsets collected while an image is written
+struct aif_tile_table {
+    uint32_t tile_width;
+    uint32_t tile_height;
+    size_t n_tiles;
+    uint64_t *offsets;
+    // Tiles added so far and the offset of the next one
+    size_t n_added;
+    uint64_t pos;
+};
+
+// Tiles of an existing file; the table points into the file's data
+struct aif_tile_view {
+    const uint8_t *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    // End of the last tile (start of the offset table)
+    size_t tiles_end;
+    const uint8_t *entries;
+};
+
+// Prepares to tile an image of width x height pixels; returns FALSE if
+// out of memory
+int aif_tile_table_init(struct aif_tile_table *table, uint32_t width, uint32_t height);
+// Writes the tile size that starts the pixel data; returns FALSE on failure
+int aif_tile_table_start(struct aif_writer *out, const struct aif_tile_table *table);
+// Writes the next tile, encoded by aif_tile_encode_rows; returns FALSE on
+// failure
+int aif_tile_write(
+    struct aif_writer *out,
+    struct aif_tile_table *table,
+    const uint8_t *tile,
+    size_t len
+);
+// Appends the offset table once every tile is written; returns FALSE on
+// failure
+int aif_tile_table_write(struct aif_writer *out, const struct aif_tile_table *table);
+// Frees the offsets
+void aif_tile_table_free(struct aif_tile_table *table);
+
+// Compresses n_rows rows of width pixels, stride bytes apart, with their
+// length prefixes; returns the number of bytes written to out
+size_t aif_tile_encode_rows(
+    const uint8_t *pixels,
+    size_t stride,
+    uint32_t width,
+    uint32_t n_rows,
+    size_t bpp,
+    uint8_t *out
+);
+
+// Checks the tile size and offset table of size bytes of pixel data;
+// returns FALSE if they do not describe a width x height image
+int aif_tile_find(
+    const uint8_t *data,
+    size_t size,
+    uint32_t width,
+    uint32_t height,
+    struct aif_tile_view *view
+);
+// Decodes rows y .. y + n_rows - 1 and columns x .. x + n - 1 (counted
+// within the tile) of tile (tx, ty) into out, stride bytes per row
+int aif_tile_decode(
+    const struct aif_tile_view *view,
+    uint32_t tx,
+    uint32_t ty,
+    size_t bpp,
+    uint32_t x,
+    uint32_t y,
+    uint32_t n,
+    uint32_t n_rows,
+    uint8_t *out,
+    size_t stride
+);
+// Decodes the rectangle of width x height pixels at (x, y) of the image
+// into out, stride bytes per row, touching only the tiles it covers
+int aif_tile_decode_region(
+    const struct aif_tile_view *view,
+    size_t bpp,
+    uint32_t x,
+    uint32_t y,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out,
+    size_t stride
+);
+
+#endif
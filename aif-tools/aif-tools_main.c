@@ -4,12 +4,18 @@
 #include <string.h>
 #include <stdlib.h>
 
-#define NUM_OPS 5
+#define NUM_OPS 7
 
 void stage2_brighten_args(int n_args, const char **args);
 void stage3_convert_color_args(int n_args, const char **args);
 void stage4_decompress_args(int n_args, const char **args);
 void stage5_compress_args(int n_args, const char **args);
+void stage6_pipeline_args(int n_args, const char **args);
+void stage7_crop_args(int n_args, const char **args);
+int take_threads_option(int *n_args, const char **args);
+const char *take_out_dir_option(int *n_args, const char **args);
+int take_flag(int *n_args, const char **args, const char *flag);
+int take_job(int n_args, const char **args, int n_fixed, struct aif_job *job);
 
 struct aif_operation {
     const char *name;
@@ -22,6 +28,8 @@ const struct aif_operation operations[] = {
     {"convert-color", stage3_convert_color_args},
     {"decompress", stage4_decompress_args},
     {"compress", stage5_compress_args},
+    {"pipeline", stage6_pipeline_args},
+    {"crop", stage7_crop_args},
 };
 
 int main(int argc, const char **argv) {
@@ -45,9 +53,109 @@ int main(int argc, const char **argv) {
     return 1;
 }
 
+// Removes a `--threads N` option from the argument list if present and
+// returns N (1 if the option was not given)
+int take_threads_option(int *n_args, const char **args) {
+    int n_threads = 1;
+
+    for (int i = 0; i < *n_args; i++) {
+        if (strcmp(args[i], "--threads") != 0) {
+            continue;
+        }
+
+        if (i + 1 >= *n_args || atoi(args[i + 1]) < 1) {
+            fprintf(stderr, "--threads requires a positive number of threads\n");
+            exit(EXIT_FAILURE);
+        }
+        n_threads = atoi(args[i + 1]);
+
+        for (int j = i + 2; j < *n_args; j++) {
+            args[j - 2] = args[j];
+        }
+        *n_args -= 2;
+        i--;
+    }
+
+    return n_threads;
+}
+
+// Removes a `--out-dir DIR` option from the argument list if present and
+// returns DIR (NULL if the option was not given)
+const char *take_out_dir_option(int *n_args, const char **args) {
+    const char *out_dir = NULL;
+
+    for (int i = 0; i < *n_args; i++) {
+        if (strcmp(args[i], "--out-dir") != 0) {
+            continue;
+        }
+
+        if (i + 1 >= *n_args) {
+            fprintf(stderr, "--out-dir requires a directory\n");
+            exit(EXIT_FAILURE);
+        }
+        out_dir = args[i + 1];
+
+        for (int j = i + 2; j < *n_args; j++) {
+            args[j - 2] = args[j];
+        }
+        *n_args -= 2;
+        i--;
+    }
+
+    return out_dir;
+}
+
+// Removes every occurrence of flag from the argument list and returns 1
+// if there were any
+int take_flag(int *n_args, const char **args, const char *flag) {
+    int found = 0;
+
+    for (int i = 0; i < *n_args; i++) {
+        if (strcmp(args[i], flag) != 0) {
+            continue;
+        }
+
+        found = 1;
+        for (int j = i + 1; j < *n_args; j++) {
+            args[j - 1] = args[j];
+        }
+        *n_args -= 1;
+        i--;
+    }
+
+    return found;
+}
+
+// Takes the options and files of a stage that reads and writes images,
+// leaving its own n_fixed arguments at the start of args. Files are
+// `<in-file> <out-file>`, or with --out-dir one or more input files.
+// Returns 0 if any arguments are missing
+int take_job(int n_args, const char **args, int n_fixed, struct aif_job *job) {
+    job->n_threads = take_threads_option(&n_args, args);
+    job->out_dir = take_out_dir_option(&n_args, args);
+    job->row_index = take_flag(&n_args, args, "--row-index");
+    job->in_files = args + n_fixed;
+    n_args -= n_fixed;
+
+    if (job->out_dir != NULL) {
+        job->n_in_files = n_args;
+        job->out_file = NULL;
+        return n_args >= 1;
+    }
+
+    job->n_in_files = 1;
+    job->out_file = job->in_files[1];
+    return n_args >= 2;
+}
+
 void stage2_brighten_args(int n_args, const char **args) {
-    if (n_args < 3) {
-        fprintf(stderr, "Usage: aif-tools brighten <amount> <in-file> <out-file>\n");
+    struct aif_job job;
+    if (!take_job(n_args, args, 1, &job)) {
+        fprintf(
+            stderr,
+            "Usage: aif-tools brighten [--threads N] [--row-index] <amount> <in-file> <out-file>\n"
+            "       aif-tools brighten [--threads N] [--row-index] --out-dir <dir> <amount> <in-file>...\n"
+        );
         exit(EXIT_FAILURE);
     }
 
@@ -57,37 +165,89 @@ void stage2_brighten_args(int n_args, const char **args) {
         exit(EXIT_FAILURE);
     }
 
-    stage2_brighten(amount, args[1], args[2]);
+    stage2_brighten(amount, &job);
 }
 
 void stage3_convert_color_args(int n_args, const char **args) {
-    if (n_args < 3) {
+    struct aif_job job;
+    if (!take_job(n_args, args, 1, &job)) {
         fprintf(
             stderr,
-            "Usage: aif-tools convert-color <color-format> <in-file> <out-file>\n"
+            "Usage: aif-tools convert-color [--threads N] [--row-index] <color-format> <in-file> <out-file>\n"
+            "       aif-tools convert-color [--threads N] [--row-index] --out-dir <dir> <color-format> <in-file>...\n"
         );
         exit(EXIT_FAILURE);
     }
 
-    stage3_convert_color(args[0], args[1], args[2]);
+    stage3_convert_color(args[0], &job);
 }
 
 void stage4_decompress_args(int n_args, const char **args) {
-    if (n_args < 2) {
-        fprintf(stderr, "Usage: aif-tools decompress <in-file> <out-file>\n");
+    struct aif_job job;
+    if (!take_job(n_args, args, 0, &job)) {
+        fprintf(
+            stderr,
+            "Usage: aif-tools decompress [--threads N] [--row-index] <in-file> <out-file>\n"
+            "       aif-tools decompress [--threads N] [--row-index] --out-dir <dir> <in-file>...\n"
+        );
         exit(EXIT_FAILURE);
     }
 
-    stage4_decompress(args[0], args[1]);
+    stage4_decompress(&job);
 }
 
 void stage5_compress_args(int n_args, const char **args) {
-    if (n_args < 2) {
-        fprintf(stderr, "Usage: aif-tools compress <in-file> <out-file>\n");
+    struct aif_job job;
+    int tiled = take_flag(&n_args, args, "--tiled");
+    if (!take_job(n_args, args, 0, &job)) {
+        fprintf(
+            stderr,
+            "Usage: aif-tools compress [--threads N] [--row-index | --tiled] <in-file> <out-file>\n"
+            "       aif-tools compress [--threads N] [--row-index | --tiled] --out-dir <dir> <in-file>...\n"
+        );
+        exit(EXIT_FAILURE);
+    }
+
+    stage5_compress(tiled, &job);
+}
+
+void stage6_pipeline_args(int n_args, const char **args) {
+    struct aif_job job;
+    if (!take_job(n_args, args, 1, &job)) {
+        fprintf(
+            stderr,
+            "Usage: aif-tools pipeline [--threads N] [--row-index] <op>[,<op>...] <in-file> <out-file>\n"
+            "       aif-tools pipeline [--threads N] [--row-index] --out-dir <dir> <op>[,<op>...] <in-file>...\n"
+            "Operations: brighten=<amount>, convert-color=<gray8|rgb8>, crop=<x>:<y>:<w>:<h>,\n"
+            "            compress[=tiled], decompress\n"
+        );
+        exit(EXIT_FAILURE);
+    }
+
+    stage6_pipeline(args[0], &job);
+}
+
+void stage7_crop_args(int n_args, const char **args) {
+    struct aif_job job;
+    if (!take_job(n_args, args, 4, &job)) {
+        fprintf(
+            stderr,
+            "Usage: aif-tools crop [--threads N] [--row-index] <x> <y> <width> <height> <in-file> <out-file>\n"
+            "       aif-tools crop [--threads N] [--row-index] --out-dir <dir> <x> <y> <width> <height> <in-file>...\n"
+        );
+        exit(EXIT_FAILURE);
+    }
+
+    int x = atoi(args[0]);
+    int y = atoi(args[1]);
+    int width = atoi(args[2]);
+    int height = atoi(args[3]);
+    if (x < 0 || y < 0 || width < 1 || height < 1) {
+        fprintf(stderr, "Crop position must not be negative and its size must be positive\n");
         exit(EXIT_FAILURE);
     }
 
-    stage5_compress(args[0], args[1]);
+    stage7_crop(x, y, width, height, &job);
 }
 
 int aif_pixel_format_bpp(int format) {
@@ -118,6 +278,10 @@ const char *aif_compression_name(int compression) {
         return "none";
     case AIF_COMPRESSION_RLE:
         return "run-length encoding compressed";
+    case AIF_COMPRESSION_TILED:
+        return "tiled run-length encoding compressed";
+    case AIF_COMPRESSION_RLE_WIDE:
+        return "run-length encoding compressed (wide rows)";
     default:
         return NULL;
     }
@@ -26,6 +26,20 @@
 
 #define AIF_COMPRESSION_NONE (0)
 #define AIF_COMPRESSION_RLE (1)
+#define AIF_COMPRESSION_TILED (2)
+#define AIF_COMPRESSION_RLE_WIDE (3)
+
+#define AIF_OK (0)
+#define AIF_ERR_EOF (1)
+#define AIF_ERR_CORRUPT (2)
+#define AIF_ERR_WRITE (3)
+#define AIF_ERR_NO_MEMORY (4)
+#define AIF_ERR_OPEN (5)
+#define AIF_ERR_INVALID (6)
+#define AIF_ERR_OPEN_OUTPUT (7)
+#define AIF_ERR_ARGUMENT (8)
+#define AIF_ERR_REGION (9)
+#define AIF_ERR_CLASH (10)
 
 // Takes in a pixel format and returns the number of bits per pixel
 int aif_pixel_format_bpp(int format);
@@ -34,10 +48,32 @@ const char *aif_pixel_format_name(int format);
 // Takes in a compression format and returns its name as a string
 const char *aif_compression_name(int compression);
 
+// Files a stage works on: one input written to out_file, or in batch mode
+// (out_dir set) any number of inputs, each written to out_dir under its
+// own name
+struct aif_job {
+    int n_in_files;
+    const char **in_files;
+    const char *out_file;
+    const char *out_dir;
+    // Threads used within the image, or in batch mode files done at once
+    int n_threads;
+    // Set to end compressed output with a row index
+    int row_index;
+};
+
 void stage1_info(int n_files, const char **files);
-void stage2_brighten(int amount, const char *in_file, const char *out_file);
-void stage3_convert_color(const char *color, const char *in_file, const char *out_file);
-void stage4_decompress(const char *in_file, const char *out_file);
-void stage5_compress(const char *in_file, const char *out_file);
+void stage2_brighten(int amount, const struct aif_job *job);
+void stage3_convert_color(const char *color, const struct aif_job *job);
+void stage4_decompress(const struct aif_job *job);
+void stage5_compress(int tiled, const struct aif_job *job);
+void stage6_pipeline(const char *chain, const struct aif_job *job);
+void stage7_crop(
+    uint32_t x,
+    uint32_t y,
+    uint32_t width,
+    uint32_t height,
+    const struct aif_job *job
+);
 
 #endif
@@ -1,23 +1,81 @@
-CFLAGS =
+# Large-file I/O, so 32-bit builds see files past 2 GB
+CFLAGS = -D_FILE_OFFSET_BITS=64
+# No fused multiply-adds, so that the vector brighten rounds exactly as
+# brighten_rgb does whatever -march is used (tests/test-brighten checks it)
+CFLAGS += -ffp-contract=off
+LDFLAGS = -pthread
 
 ifneq (, $(shell which dcc))
 CC	?= dcc
 else
 CC	?= clang
-CFLAGS += -Wall
+CFLAGS += -Wall -O2
 endif
 
-EXERCISES	  += aif-tools
+EXERCISES	  += aif-tools libaif.a libaif.so
 
 SRC = aif-tools_main.c aif-tools.c
-INCLUDES = aif.h
+INCLUDES = aif.h aif-image.h
 
+# libaif: everything but the command-line front end
 # if you add extra .c files, add them here
-SRC +=
+LIB_SRC = aif-brighten.c aif-cache.c aif-checksum.c aif-convert.c aif-image.c aif-index.c aif-io.c aif-lut.c aif-pool.c aif-rle.c aif-stream.c aif-tile.c
 
 # if you add extra .h files, add them here
-INCLUDES +=
+LIB_INCLUDES = aif.h aif-brighten.h aif-cache.h aif-checksum.h aif-convert.h aif-image.h aif-index.h aif-io.h aif-lut.h aif-pool.h aif-rle.h aif-stream.h aif-tile.h
 
+LIB_OBJ = $(LIB_SRC:.c=.o)
 
-aif-tools:	$(SRC) $(INCLUDES)
-	$(CC) $(CFLAGS) $(SRC) -o $@
+CLEAN_FILES	  += aif-tools libaif.a libaif.so $(LIB_OBJ)
+
+
+$(LIB_OBJ):	$(LIB_INCLUDES)
+
+libaif.a:	$(LIB_OBJ)
+	$(AR) rcs $@ $(LIB_OBJ)
+
+libaif.so:	$(LIB_SRC) $(LIB_INCLUDES)
+	$(CC) $(CFLAGS) -fPIC -fvisibility=hidden -shared $(LIB_SRC) -o $@ $(LDFLAGS)
+
+aif-tools:	$(SRC) $(INCLUDES) libaif.a
+	$(CC) $(CFLAGS) $(SRC) libaif.a -o $@ $(LDFLAGS)
+
+# Benchmarks; built and run by `make bench`, not part of `all`
+BENCH = bench/bench-brighten bench/bench-checksum bench/bench-convert bench/bench-decode bench/bench-rle
+
+CLEAN_FILES	  += $(BENCH)
+
+.PHONY: bench
+
+bench/bench-%:	bench/bench-%.c bench/bench.c bench/bench.h $(LIB_INCLUDES) libaif.a
+	$(CC) $(CFLAGS) $< bench/bench.c libaif.a -o $@ $(LDFLAGS)
+
+# Counts the allocations the library makes
+bench/bench-decode:	LDFLAGS += -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=aligned_alloc,--wrap=strdup
+
+bench:	$(BENCH)
+	./bench/bench-brighten
+	./bench/bench-checksum
+	./bench/bench-convert
+	./bench/bench-decode
+	./bench/bench-rle
+
+# Tests; built and run by `make test`, not part of `all`
+TESTS = tests/test-brighten tests/test-cache tests/test-convert tests/test-lut
+
+CLEAN_FILES	  += $(TESTS) tests/test-large
+
+.PHONY: test test-large
+
+tests/test-%:	tests/test-%.c $(LIB_INCLUDES) libaif.a
+	$(CC) $(CFLAGS) $< libaif.a -o $@ $(LDFLAGS)
+
+test:	$(TESTS)
+	./tests/test-brighten
+	./tests/test-cache
+	./tests/test-convert
+	./tests/test-lut
+
+# Images past 4 GB; needs about 9 GB of disk, so only run when asked for
+test-large:	tests/test-large
+	./tests/test-large
@@ -0,0 +1,147 @@
+// Description: RGB brighten throughput. Times brighten_rgb, the original
+//              one pixel at a time path, against aif_brighten_rgb_simd
+//              with brighten_rgb finishing the tail, as the brighten
+//              operation runs them, on the pixels of bridge.aif and on
+//              noise of the same size, and checks that both agree.
+//
+//              Usage: bench-brighten [image] [amount]
+
+#include "bench.h"
+#include "../aif-brighten.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Image brightened, relative to aif-tools
+#define DEFAULT_IMAGE "aif-examples/bridge.aif"
+#define DEFAULT_AMOUNT 20
+
+struct brighten_run {
+    const struct bench_image *image;
+    uint8_t *out;
+    int amount;
+};
+
+// Description: Brighten one row of pixels with brighten_rgb.
+// Params:
+// - in: source pixels
+// - out: destination pixels
+// - from: first pixel to brighten
+// - n_pixels: pixels in the row
+// - amount: brighten/darken percentage
+// Returns: void.
+static void brighten_scalar(const uint8_t *in, uint8_t *out, size_t from,
+                            size_t n_pixels, int amount) {
+    for (size_t i = from * 3; i < n_pixels * 3; i += 3) {
+        uint32_t colour = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        colour = brighten_rgb(colour, amount);
+        out[i] = (colour >> 16) & 0xFF;
+        out[i + 1] = (colour >> 8) & 0xFF;
+        out[i + 2] = colour & 0xFF;
+    }
+}
+
+// Description: Brighten every row with brighten_rgb alone.
+// Params:
+// - ctx: struct brighten_run
+// Returns: void.
+static void run_original(void *ctx) {
+    struct brighten_run *run = ctx;
+    const struct bench_image *image = run->image;
+    size_t row_bytes = (size_t)image->width * 3;
+    for (uint32_t r = 0; r < image->height; r++) {
+        brighten_scalar(image->pixels + r * row_bytes, run->out + r * row_bytes, 0,
+                        image->width, run->amount);
+    }
+}
+
+// Description: Brighten every row with the vector kernel and brighten_rgb
+//              for the pixels it leaves over.
+// Params:
+// - ctx: struct brighten_run
+// Returns: void.
+static void run_simd(void *ctx) {
+    struct brighten_run *run = ctx;
+    const struct bench_image *image = run->image;
+    size_t row_bytes = (size_t)image->width * 3;
+    for (uint32_t r = 0; r < image->height; r++) {
+        const uint8_t *in = image->pixels + r * row_bytes;
+        uint8_t *out = run->out + r * row_bytes;
+        size_t done = aif_brighten_rgb_simd(in, out, image->width, run->amount);
+        brighten_scalar(in, out, done, image->width, run->amount);
+    }
+}
+
+// Description: Print the pixel rate of one measurement; brighten costs
+//              per pixel rather than per byte.
+// Params:
+// - label: what was measured
+// - image: image brightened per run
+// - seconds: seconds per run
+// Returns: void.
+static void report_pixels(const char *label, const struct bench_image *image,
+                          double seconds) {
+    double pixels = (double)image->width * image->height;
+    printf("%-44s %9.3f ms %8.1f Mpixel/s\n", label, seconds * 1e3, pixels / seconds / 1e6);
+}
+
+// Description: Time both paths on one image.
+// Params:
+// - image: RGB8 image
+// - name: image name for the labels
+// - amount: brighten/darken percentage
+// Returns: TRUE if both paths agree, else FALSE.
+static int bench_image_brighten(const struct bench_image *image, const char *name,
+                                int amount) {
+    size_t bytes = (size_t)image->width * image->height * 3;
+    uint8_t *a = malloc(bytes);
+    uint8_t *b = malloc(bytes);
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(a);
+        free(b);
+        return FALSE;
+    }
+
+    printf("%s (%ux%u), brighten by %d:\n", name, image->width, image->height, amount);
+    struct brighten_run original = { image, a, amount };
+    report_pixels("  brighten_rgb per pixel (original)", image,
+                  bench_time(run_original, &original));
+    if (!aif_brighten_rgb_has_simd()) {
+        printf("  no vector kernel on this CPU\n");
+    }
+    struct brighten_run simd = { image, b, amount };
+    report_pixels("  aif_brighten_rgb_simd + tail", image, bench_time(run_simd, &simd));
+
+    int agrees = memcmp(a, b, bytes) == 0;
+    if (!agrees) {
+        fprintf(stderr, "%s: the paths disagree\n", name);
+    }
+    free(a);
+    free(b);
+    return agrees;
+}
+
+int main(int argc, char **argv) {
+    const char *filename = argc > 1 ? argv[1] : DEFAULT_IMAGE;
+    int amount = argc > 2 ? atoi(argv[2]) : DEFAULT_AMOUNT;
+    struct bench_image image;
+    if (!bench_load(filename, &image)) {
+        return EXIT_FAILURE;
+    }
+    if (image.bpp != 3) {
+        fprintf(stderr, "%s: not an RGB8 image\n", filename);
+        free(image.pixels);
+        return EXIT_FAILURE;
+    }
+
+    int failed = !bench_image_brighten(&image, filename, amount);
+    bench_noise(image.pixels, (size_t)image.width * image.height * 3, 1);
+    failed |= !bench_image_brighten(&image, "noise", amount);
+    free(image.pixels);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+// Description: Checksum throughput. Times the byte-at-a-time loop the
+//              checksum started out as (run over memory, so without its
+//              fgetc calls) against the block engine on one thread, on
+//              every CPU, and fed in writer-sized pieces, and checks that
+//              all of them agree.
+//
+//              Usage: bench-checksum [MiB]
+
+#include "bench.h"
+#include "../aif.h"
+#include "../aif-checksum.h"
+#include "../aif-pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Default amount of data to checksum
+#define DEFAULT_MIB 256
+// Piece size of the incremental run, as the output writer feeds it
+#define PIECE_SIZE (64 << 10)
+
+struct checksum_run {
+    const uint8_t *data;
+    size_t size;
+    int n_threads;
+    uint16_t result;
+};
+
+// Description: The original checksum, one byte and two reductions at a
+//              time.
+// Params:
+// - ctx: struct checksum_run
+// Returns: void; the checksum is left in result.
+static void run_bytewise(void *ctx) {
+    struct checksum_run *run = ctx;
+    int sum1 = 0;
+    int sum2 = 0;
+    for (size_t pos = 0; pos < run->size; pos++) {
+        int byte = run->data[pos];
+        if (pos == AIF_CHECKSUM_OFFSET || pos == AIF_CHECKSUM_OFFSET + 1) {
+            byte = 0;
+        }
+        sum1 = (sum1 + byte) % 256;
+        sum2 = (sum2 + sum1) % 256;
+    }
+    run->result = (uint16_t)((sum2 << 8) | sum1);
+}
+
+// Description: Checksum the whole buffer at once.
+// Params:
+// - ctx: struct checksum_run
+// Returns: void; the checksum is left in result.
+static void run_buffer(void *ctx) {
+    struct checksum_run *run = ctx;
+    run->result = aif_checksum_buffer(run->data, run->size, run->n_threads);
+}
+
+// Description: Checksum the buffer in pieces, as written output is.
+// Params:
+// - ctx: struct checksum_run
+// Returns: void; the checksum is left in result.
+static void run_pieces(void *ctx) {
+    struct checksum_run *run = ctx;
+    struct aif_checksum c;
+    aif_checksum_init(&c);
+    for (size_t pos = 0; pos < run->size; pos += PIECE_SIZE) {
+        size_t n = run->size - pos < PIECE_SIZE ? run->size - pos : PIECE_SIZE;
+        aif_checksum_update(&c, run->data + pos, n);
+    }
+    run->result = aif_checksum_value(&c);
+}
+
+int main(int argc, char **argv) {
+    size_t mib = DEFAULT_MIB;
+    if (argc > 1) {
+        mib = strtoul(argv[1], NULL, 10);
+    }
+    size_t size = mib << 20;
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    bench_noise(data, size, 1);
+
+    struct checksum_run reference = { data, size, 1, 0 };
+    double seconds = bench_time(run_bytewise, &reference);
+    printf("Checksum of %zu MiB of noise:\n", mib);
+    bench_report("byte at a time (original)", size, seconds);
+
+    int n_cpus = aif_cpu_count();
+    char threads_label[64];
+    snprintf(threads_label, sizeof(threads_label), "aif_checksum_buffer, %d threads", n_cpus);
+    struct {
+        const char *label;
+        bench_fn fn;
+        int n_threads;
+    } engines[] = {
+        { "aif_checksum_buffer, 1 thread", run_buffer, 1 },
+        { threads_label, run_buffer, n_cpus },
+        { "aif_checksum_update, 64 KiB pieces", run_pieces, 1 },
+    };
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        // The threaded run only differs on a machine with several CPUs
+        if (i == 1 && n_cpus == 1) {
+            continue;
+        }
+        struct checksum_run run = { data, size, engines[i].n_threads, 0 };
+        seconds = bench_time(engines[i].fn, &run);
+        bench_report(engines[i].label, size, seconds);
+        if (run.result != reference.result) {
+            fprintf(stderr, "%s: checksum %04x, expected %04x\n", engines[i].label,
+                    run.result, reference.result);
+            failed = 1;
+        }
+    }
+
+    free(data);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+// Description: Pixel format conversion throughput. Times each RGB8 to
+//              GRAY8 and GRAY8 to RGB8 kernel the CPU can run on the
+//              pixels of bridge.aif (702x702 RGB8). The kernels are
+//              static, so the file is included.
+//
+//              Usage: bench-convert [image]
+
+#include "bench.h"
+#include "../aif-convert.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Image converted, relative to aif-tools
+#define DEFAULT_IMAGE "aif-examples/bridge.aif"
+
+typedef void (*convert_fn)(const uint8_t *in, uint8_t *out, size_t n_pixels);
+
+struct convert_run {
+    convert_fn fn;
+    const uint8_t *in;
+    uint8_t *out;
+    size_t n_pixels;
+};
+
+// Description: Convert the whole image once.
+// Params:
+// - ctx: struct convert_run
+// Returns: void.
+static void run_convert(void *ctx) {
+    struct convert_run *run = ctx;
+    run->fn(run->in, run->out, run->n_pixels);
+}
+
+int main(int argc, char **argv) {
+    const char *filename = argc > 1 ? argv[1] : DEFAULT_IMAGE;
+    struct bench_image image;
+    if (!bench_load(filename, &image)) {
+        return EXIT_FAILURE;
+    }
+    if (image.bpp != 3) {
+        fprintf(stderr, "%s: not an RGB8 image\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    size_t n_pixels = (size_t)image.width * image.height;
+    uint8_t *gray = malloc(n_pixels);
+    uint8_t *rgb = malloc(n_pixels * 3);
+    if (gray == NULL || rgb == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    struct {
+        const char *name;
+        convert_fn rgb_to_gray;
+        convert_fn gray_to_rgb;
+        int supported;
+    } kernels[] = {
+        { "scalar", rgb_to_gray_scalar, gray_to_rgb_scalar, 1 },
+#ifdef AIF_CONVERT_X86
+        { "ssse3", rgb_to_gray_ssse3, gray_to_rgb_ssse3, __builtin_cpu_supports("ssse3") },
+        { "avx2", rgb_to_gray_avx2, gray_to_rgb_avx2, __builtin_cpu_supports("avx2") },
+#endif
+    };
+
+    // Throughput is counted in RGB8 bytes both ways
+    printf("%s (%ux%u):\n", filename, image.width, image.height);
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (!kernels[i].supported) {
+            continue;
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "  RGB8 to GRAY8, %s", kernels[i].name);
+        struct convert_run run = { kernels[i].rgb_to_gray, image.pixels, gray, n_pixels };
+        bench_report(label, n_pixels * 3, bench_time(run_convert, &run));
+    }
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (!kernels[i].supported) {
+            continue;
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "  GRAY8 to RGB8, %s", kernels[i].name);
+        struct convert_run run = { kernels[i].gray_to_rgb, gray, rgb, n_pixels };
+        bench_report(label, n_pixels * 3, bench_time(run_convert, &run));
+    }
+
+    free(image.pixels);
+    free(gray);
+    free(rgb);
+    return EXIT_SUCCESS;
+}
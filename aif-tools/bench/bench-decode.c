@@ -0,0 +1,283 @@
+// Description: RLE decoding throughput and allocations. Times decoding
+//              every row of an RLE image with a buffer allocated and freed
+//              per row, as aif_decompress_image used to, against
+//              aif_image_read_rows and a whole decompressing transform,
+//              and counts the allocations each makes. Linked with
+//              --wrap=malloc and friends (see aif.mk), so that every
+//              allocation the library makes goes through the counters
+//              below. Fails if aif_image_read_rows allocates at all.
+//
+//              Usage: bench-decode [examples directory]
+
+#include "bench.h"
+#include "../aif.h"
+#include "../aif-image.h"
+#include "../aif-rle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Where the example images are, relative to aif-tools
+#define DEFAULT_EXAMPLES "aif-examples"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+char *__real_strdup(const char *s);
+
+// Allocations made since the program started; the library's workers may
+// allocate too, so it is updated atomically
+static unsigned long n_allocs = 0;
+
+static void count_alloc(void) {
+    __atomic_fetch_add(&n_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size) {
+    count_alloc();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    count_alloc();
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    count_alloc();
+    return __real_realloc(ptr, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+    count_alloc();
+    return __real_aligned_alloc(alignment, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    count_alloc();
+    return __real_strdup(s);
+}
+
+// Description: Read the allocation counter.
+// Params: none.
+// Returns: allocations made so far.
+static unsigned long allocs(void) {
+    return __atomic_load_n(&n_allocs, __ATOMIC_RELAXED);
+}
+
+struct decode_run {
+    struct aif_image *img;
+    // Compressed rows (the file after its header) for the per-row run
+    const uint8_t *data;
+    size_t size;
+    uint8_t *pixels;
+    const char *out_file;
+    int status;
+};
+
+// Description: Decode every row, copying each compressed row into a
+//              buffer allocated for it, as the original decoder did.
+// Params:
+// - ctx: struct decode_run
+// Returns: void; the result is left in status.
+static void run_per_row(void *ctx) {
+    struct decode_run *run = ctx;
+    uint32_t width = aif_image_width(run->img);
+    size_t bpp = aif_image_bpp(run->img);
+    size_t row_bytes = (size_t)width * bpp;
+    size_t pos = 0;
+    run->status = AIF_OK;
+    for (uint32_t r = 0; r < aif_image_height(run->img); r++) {
+        if (run->size - pos < 2) {
+            run->status = AIF_ERR_EOF;
+            return;
+        }
+        uint32_t row_len = run->data[pos] | (run->data[pos + 1] << 8);
+        pos += 2;
+        if (run->size - pos < row_len) {
+            run->status = AIF_ERR_EOF;
+            return;
+        }
+        uint8_t *comp = malloc(row_len > 0 ? row_len : 1);
+        if (comp == NULL) {
+            run->status = AIF_ERR_NO_MEMORY;
+            return;
+        }
+        memcpy(comp, run->data + pos, row_len);
+        pos += row_len;
+        int ok = decompress_row(comp, row_len, run->pixels + r * row_bytes, row_bytes, bpp);
+        free(comp);
+        if (!ok) {
+            run->status = AIF_ERR_CORRUPT;
+            return;
+        }
+    }
+}
+
+// Description: Decode every row with aif_image_read_rows.
+// Params:
+// - ctx: struct decode_run
+// Returns: void; the result is left in status.
+static void run_read_rows(void *ctx) {
+    struct decode_run *run = ctx;
+    run->status = aif_image_seek_row(run->img, 0);
+    if (run->status == AIF_OK) {
+        run->status = aif_image_read_rows(run->img, run->pixels,
+                                          aif_image_height(run->img));
+    }
+}
+
+// Description: Decompress the whole image into an uncompressed file.
+// Params:
+// - ctx: struct decode_run
+// Returns: void; the result is left in status.
+static void run_transform(void *ctx) {
+    struct decode_run *run = ctx;
+    struct aif_transform t;
+    memset(&t, 0, sizeof(t));
+    t.compression = AIF_COMPRESSION_NONE;
+    t.n_threads = 1;
+    run->status = aif_image_transform(run->img, run->out_file, &t);
+}
+
+// Description: Read a whole file into memory.
+// Params:
+// - filename: file to read
+// - size: receives the file size
+// Returns: malloc'd contents, or NULL (after printing why) on failure.
+static uint8_t *load_file(const char *filename, size_t *size) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        perror(filename);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(len > 0 ? len : 1);
+    if (buf == NULL || fread(buf, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "%s: could not read\n", filename);
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *size = len;
+    return buf;
+}
+
+// Description: Time one way of decoding and count the allocations one
+//              run of it makes.
+// Params:
+// - label: what is measured
+// - fn: work to run
+// - run: passed to fn
+// - bytes: decoded bytes per run
+// Returns: allocations made by one run, or -1 (after printing why) if it
+//          failed.
+static long bench_decode(const char *label, bench_fn fn, struct decode_run *run,
+                         size_t bytes) {
+    unsigned long before = allocs();
+    fn(run);
+    long n = (long)(allocs() - before);
+    if (run->status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", label, aif_error_message(run->status));
+        return -1;
+    }
+    double seconds = bench_time(fn, run);
+    printf("%-44s %9.3f ms %8.3f GB/s %8ld allocations\n", label, seconds * 1e3,
+           bytes / seconds / 1e9, n);
+    return n;
+}
+
+// Description: Benchmark decoding one RLE image.
+// Params:
+// - filename: RLE image
+// - name: image name for the labels
+// Returns: TRUE if every run succeeded and aif_image_read_rows made no
+//          allocation, else FALSE.
+static int bench_image_decode(const char *filename, const char *name) {
+    struct decode_run run;
+    memset(&run, 0, sizeof(run));
+    int status = aif_image_open(&run.img, filename);
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        return FALSE;
+    }
+    if (aif_image_compression(run.img) != AIF_COMPRESSION_RLE) {
+        fprintf(stderr, "%s: not an RLE image\n", filename);
+        aif_image_close(run.img);
+        return FALSE;
+    }
+
+    uint32_t height = aif_image_height(run.img);
+    size_t bytes = (size_t)aif_image_width(run.img) * height * aif_image_bpp(run.img);
+    size_t file_size = 0;
+    uint8_t *file = load_file(filename, &file_size);
+    run.pixels = malloc(bytes > 0 ? bytes : 1);
+    char out_file[] = "/tmp/bench-decode-XXXXXX";
+    int fd = mkstemp(out_file);
+    if (file == NULL || run.pixels == NULL || fd < 0) {
+        fprintf(stderr, "%s: could not set up\n", name);
+        if (fd >= 0) {
+            close(fd);
+            unlink(out_file);
+        }
+        free(file);
+        free(run.pixels);
+        aif_image_close(run.img);
+        return FALSE;
+    }
+    close(fd);
+    run.data = file + AIF_HEADER_SIZE;
+    run.size = file_size - AIF_HEADER_SIZE;
+    run.out_file = out_file;
+
+    printf("%s (%u rows):\n", name, height);
+    struct {
+        const char *label;
+        bench_fn fn;
+    } decoders[] = {
+        { "  malloc per row (original)", run_per_row },
+        { "  aif_image_read_rows", run_read_rows },
+        { "  decompressing aif_image_transform", run_transform },
+    };
+    int ok = TRUE;
+    for (size_t i = 0; i < sizeof(decoders) / sizeof(decoders[0]); i++) {
+        long n = bench_decode(decoders[i].label, decoders[i].fn, &run, bytes);
+        if (n < 0) {
+            ok = FALSE;
+            continue;
+        }
+        if (decoders[i].fn == run_read_rows && n != 0) {
+            fprintf(stderr, "%s: aif_image_read_rows allocated %ld times\n", name, n);
+            ok = FALSE;
+        }
+    }
+
+    unlink(out_file);
+    free(file);
+    free(run.pixels);
+    aif_image_close(run.img);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *examples = argc > 1 ? argv[1] : DEFAULT_EXAMPLES;
+    const char *names[] = { "screenshot-compressed.aif", "mr2-compressed.aif" };
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", examples, names[i]);
+        if (!bench_image_decode(path, names[i])) {
+            failed = 1;
+        }
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+// Description: RLE compression throughput. Times compress_row against the
+//              encoder it replaced, which measured the run at every column
+//              and compared pixels a byte at a time, on a screenshot (long
+//              runs), a photo (short runs) and noise (no runs), and checks
+//              that both produce the same bytes.
+//
+//              Usage: bench-rle [examples directory]
+
+#include "bench.h"
+#include "../aif.h"
+#include "../aif-rle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Where the example images are, relative to aif-tools
+#define DEFAULT_EXAMPLES "aif-examples"
+// Size of the RGB noise image, that of bridge.aif
+#define NOISE_WIDTH 702
+#define NOISE_HEIGHT 702
+
+struct rle_run {
+    const struct bench_image *image;
+    uint8_t *out;
+    size_t total;
+};
+
+// Description: Length of the run of pixels equal to the one at start, as
+//              the original encoder measured it.
+// Params:
+// - row: row data buffer
+// - width: pixels in the row
+// - bpp: bytes per pixel
+// - start: column index to begin
+// Returns: run length (>=1).
+static size_t original_measure_run(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint32_t start
+) {
+    size_t run = 1;
+    while ((uint32_t)(start + run) < width) {
+        const uint8_t *p1 = row + (size_t)start * bpp;
+        const uint8_t *p2 = row + (size_t)(start + run) * bpp;
+        for (size_t k = 0; k < bpp; k++) {
+            if (p1[k] != p2[k]) {
+                return run;
+            }
+        }
+        run++;
+    }
+    return run;
+}
+
+// Description: The original compress_row.
+// Params:
+// - row: row data buffer
+// - width: number of pixels in row
+// - bpp: bytes per pixel
+// - out: output buffer
+// Returns: number of bytes written to out.
+static size_t original_compress_row(
+    const uint8_t *row,
+    uint32_t width,
+    size_t bpp,
+    uint8_t *out
+) {
+    size_t out_pos = 0;
+    uint32_t col = 0;
+    while (col < width) {
+        size_t run = original_measure_run(row, width, bpp, col);
+        if (run >= 2) {
+            const uint8_t *pixel = row + (size_t)col * bpp;
+            col += run;
+            while (run > 0) {
+                uint8_t chunk = run > 255 ? 255 : (uint8_t)run;
+                out[out_pos++] = chunk;
+                for (size_t k = 0; k < bpp; k++) {
+                    out[out_pos++] = pixel[k];
+                }
+                run -= chunk;
+            }
+            continue;
+        }
+
+        // No run: gather literals until the next run or row end
+        uint32_t lit_start = col;
+        col += 1;
+        while (col < width && original_measure_run(row, width, bpp, col) < 2) {
+            col += 1;
+        }
+        for (uint32_t emitted = lit_start; emitted < col; ) {
+            uint8_t chunk = col - emitted > 255 ? 255 : (uint8_t)(col - emitted);
+            out[out_pos++] = 0;
+            out[out_pos++] = chunk;
+            memcpy(out + out_pos, row + (size_t)emitted * bpp, (size_t)chunk * bpp);
+            out_pos += (size_t)chunk * bpp;
+            emitted += chunk;
+        }
+    }
+    return out_pos;
+}
+
+// Description: Compress every row of the image with the original encoder.
+// Params:
+// - ctx: struct rle_run
+// Returns: void; the compressed size is left in total.
+static void run_original(void *ctx) {
+    struct rle_run *run = ctx;
+    const struct bench_image *image = run->image;
+    size_t row_bytes = (size_t)image->width * image->bpp;
+    run->total = 0;
+    for (uint32_t r = 0; r < image->height; r++) {
+        run->total += original_compress_row(image->pixels + r * row_bytes,
+                                            image->width, image->bpp, run->out);
+    }
+}
+
+// Description: Compress every row of the image with compress_row.
+// Params:
+// - ctx: struct rle_run
+// Returns: void; the compressed size is left in total.
+static void run_compress_row(void *ctx) {
+    struct rle_run *run = ctx;
+    const struct bench_image *image = run->image;
+    size_t row_bytes = (size_t)image->width * image->bpp;
+    run->total = 0;
+    for (uint32_t r = 0; r < image->height; r++) {
+        run->total += compress_row(image->pixels + r * row_bytes,
+                                   image->width, image->bpp, run->out);
+    }
+}
+
+// Description: Check that both encoders produce the same bytes for every
+//              row of the image.
+// Params:
+// - image: image to compress
+// - name: image name for the message
+// - a: buffer of AIF_RLE_MAX_ROW bytes
+// - b: buffer of AIF_RLE_MAX_ROW bytes
+// Returns: TRUE if they agree, else FALSE (after printing the row).
+static int rle_agrees(const struct bench_image *image, const char *name,
+                      uint8_t *a, uint8_t *b) {
+    size_t row_bytes = (size_t)image->width * image->bpp;
+    for (uint32_t r = 0; r < image->height; r++) {
+        const uint8_t *row = image->pixels + r * row_bytes;
+        size_t a_len = original_compress_row(row, image->width, image->bpp, a);
+        size_t b_len = compress_row(row, image->width, image->bpp, b);
+        if (a_len != b_len || memcmp(a, b, a_len) != 0) {
+            fprintf(stderr, "%s: row %u compresses differently\n", name, r);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Description: Time both encoders on one image.
+// Params:
+// - image: image to compress
+// - name: image name for the labels
+// Returns: TRUE if the encoders agree, else FALSE.
+static int bench_image_rle(const struct bench_image *image, const char *name) {
+    size_t max_row = AIF_RLE_MAX_ROW(image->width, image->bpp);
+    uint8_t *a = malloc(max_row);
+    uint8_t *b = malloc(max_row);
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(a);
+        free(b);
+        return FALSE;
+    }
+
+    size_t bytes = (size_t)image->width * image->height * image->bpp;
+    printf("%s (%ux%u, %zu bpp):\n", name, image->width, image->height, image->bpp);
+    struct rle_run run = { image, a, 0 };
+    bench_report("  original encoder", bytes, bench_time(run_original, &run));
+    bench_report("  compress_row", bytes, bench_time(run_compress_row, &run));
+    printf("  compressed to %.1f%% of the pixels\n", 100.0 * run.total / bytes);
+
+    int agrees = rle_agrees(image, name, a, b);
+    free(a);
+    free(b);
+    return agrees;
+}
+
+int main(int argc, char **argv) {
+    const char *examples = argc > 1 ? argv[1] : DEFAULT_EXAMPLES;
+    const char *names[] = { "screenshot.aif", "bridge.aif" };
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", examples, names[i]);
+        struct bench_image image;
+        if (!bench_load(path, &image)) {
+            failed = 1;
+            continue;
+        }
+        if (!bench_image_rle(&image, names[i])) {
+            failed = 1;
+        }
+        free(image.pixels);
+    }
+
+    struct bench_image noise = { NULL, NOISE_WIDTH, NOISE_HEIGHT, 3 };
+    size_t noise_bytes = (size_t)noise.width * noise.height * noise.bpp;
+    noise.pixels = malloc(noise_bytes);
+    if (noise.pixels == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    bench_noise(noise.pixels, noise_bytes, 1);
+    if (!bench_image_rle(&noise, "noise")) {
+        failed = 1;
+    }
+    free(noise.pixels);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+// Description: Helpers shared by the benchmarks: timing, reporting, noise
+//              and loading images. The benchmarks link against libaif.a, so they
+//              measure the library exactly as the command-line tool uses
+//              it.
+
+#include "bench.h"
+#include "../aif.h"
+#include "../aif-image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// Description: Read a monotonic clock.
+// Params: none.
+// Returns: time in seconds from an arbitrary start.
+double bench_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Description: Time a piece of work, repeating it so that short runs
+//              are still measured accurately.
+// Params:
+// - fn: work to run
+// - ctx: passed to fn
+// Returns: average seconds per run.
+double bench_time(bench_fn fn, void *ctx) {
+    int runs = 0;
+    double start = bench_seconds();
+    double elapsed;
+    do {
+        fn(ctx);
+        runs++;
+        elapsed = bench_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return elapsed / runs;
+}
+
+// Description: Print the throughput of one measurement.
+// Params:
+// - label: what was measured
+// - bytes: bytes processed per run
+// - seconds: seconds per run
+// Returns: void.
+void bench_report(const char *label, size_t bytes, double seconds) {
+    printf("%-44s %9.3f ms %8.3f GB/s\n", label, seconds * 1e3, bytes / seconds / 1e9);
+}
+
+// Description: Generate pseudo-random bytes (xorshift32), the same for
+//              every run with the same seed.
+// Params:
+// - buf: destination
+// - n: number of bytes
+// - seed: non-zero seed
+// Returns: void.
+void bench_noise(uint8_t *buf, size_t n, uint32_t seed) {
+    uint32_t x = seed;
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = x >> 24;
+    }
+}
+
+// Description: Decode a whole image into memory.
+// Params:
+// - filename: AIF file
+// - image: filled in; pixels must be freed by the caller
+// Returns: TRUE on success, FALSE (after printing why) on failure.
+int bench_load(const char *filename, struct bench_image *image) {
+    struct aif_image *img;
+    int status = aif_image_open(&img, filename);
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        return FALSE;
+    }
+
+    image->width = aif_image_width(img);
+    image->height = aif_image_height(img);
+    image->bpp = aif_image_bpp(img);
+    image->pixels = malloc((size_t)image->width * image->height * image->bpp);
+    if (image->pixels == NULL) {
+        status = AIF_ERR_NO_MEMORY;
+    } else {
+        status = aif_image_read_rows(img, image->pixels, image->height);
+    }
+    aif_image_close(img);
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        free(image->pixels);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,33 @@
+#ifndef AIF_BENCH_H
+#define AIF_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Each measurement repeats its work for at least this long
+#define BENCH_MIN_SECONDS 0.3
+
+// Pixels of an image decoded into memory
+struct bench_image {
+    uint8_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    size_t bpp;
+};
+
+// A piece of work to time; ctx is passed back unchanged
+typedef void (*bench_fn)(void *ctx);
+
+// Returns a monotonic time in seconds
+double bench_seconds(void);
+// Runs fn until BENCH_MIN_SECONDS have passed; returns seconds per run
+double bench_time(bench_fn fn, void *ctx);
+// Prints one result line: the throughput of bytes processed in seconds
+void bench_report(const char *label, size_t bytes, double seconds);
+// Fills buf with reproducible pseudo-random bytes
+void bench_noise(uint8_t *buf, size_t n, uint32_t seed);
+// Decodes the whole of filename into image; prints why and returns FALSE
+// on failure
+int bench_load(const char *filename, struct bench_image *image);
+
+#endif
@@ -0,0 +1,127 @@
+// Description: Check that the vector RGB brighten is bit-identical to
+//              brighten_rgb for every colour at every amount. Each amount
+//              runs the kernel over one row holding all 2^24 colours, plus
+//              a few pixels of padding so that none of them is left to the
+//              scalar tail, and compares every pixel with brighten_rgb.
+//              The amounts are shared out between one thread per CPU.
+
+#include "../aif-brighten.h"
+#include "../aif-pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N_COLOURS (1 << 24)
+// Pixels after the colours, more than the kernel ever leaves over
+#define PADDING 16
+#define MIN_AMOUNT (-100)
+#define MAX_AMOUNT 100
+// Each thread needs an output row of its own
+#define MAX_THREADS 8
+
+struct brighten_check {
+    const uint8_t *in;
+    int first_amount;
+    int amount_step;
+    unsigned long n_wrong;
+    int failed;
+};
+
+// Description: Check every colour at the amounts of one thread.
+// Params:
+// - arg: struct brighten_check
+// Returns: NULL; the results are left in n_wrong and failed.
+static void *check_amounts(void *arg) {
+    struct brighten_check *check = arg;
+    uint8_t *out = malloc(((size_t)N_COLOURS + PADDING) * 3);
+    if (out == NULL) {
+        fprintf(stderr, "test-brighten: out of memory\n");
+        check->failed = 1;
+        return NULL;
+    }
+
+    for (int amount = check->first_amount; amount <= MAX_AMOUNT;
+         amount += check->amount_step) {
+        size_t done = aif_brighten_rgb_simd(check->in, out, N_COLOURS + PADDING, amount);
+        if (done < N_COLOURS) {
+            fprintf(stderr, "test-brighten: kernel stopped at %zu pixels\n", done);
+            check->failed = 1;
+            break;
+        }
+        for (uint32_t colour = 0; colour < N_COLOURS; colour++) {
+            uint32_t expected = brighten_rgb(colour, amount);
+            uint32_t got = (uint32_t)(out[colour * 3] << 16)
+                         | (out[colour * 3 + 1] << 8)
+                         | out[colour * 3 + 2];
+            if (got != expected) {
+                if (check->n_wrong < 10) {
+                    fprintf(stderr, "test-brighten: %06x by %d: got %06x, expected %06x\n",
+                            colour, amount, got, expected);
+                }
+                check->n_wrong++;
+            }
+        }
+    }
+    free(out);
+    return NULL;
+}
+
+int main(void) {
+    if (!aif_brighten_rgb_has_simd()) {
+        printf("test-brighten: no vector kernel on this CPU, nothing to check\n");
+        return EXIT_SUCCESS;
+    }
+
+    uint8_t *in = calloc((size_t)N_COLOURS + PADDING, 3);
+    if (in == NULL) {
+        fprintf(stderr, "test-brighten: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t colour = 0; colour < N_COLOURS; colour++) {
+        in[colour * 3] = colour >> 16;
+        in[colour * 3 + 1] = colour >> 8;
+        in[colour * 3 + 2] = colour;
+    }
+
+    int n_threads = aif_cpu_count();
+    if (n_threads > MAX_THREADS) {
+        n_threads = MAX_THREADS;
+    }
+    struct brighten_check checks[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int started[MAX_THREADS];
+    for (int t = 0; t < n_threads; t++) {
+        checks[t] = (struct brighten_check){ in, MIN_AMOUNT + t, n_threads, 0, 0 };
+        started[t] = t > 0
+                     && pthread_create(&threads[t], NULL, check_amounts, &checks[t]) == 0;
+    }
+    // Whatever could not get a thread of its own runs here
+    for (int t = 0; t < n_threads; t++) {
+        if (!started[t]) {
+            check_amounts(&checks[t]);
+        }
+    }
+
+    unsigned long n_wrong = 0;
+    int failed = 0;
+    for (int t = 0; t < n_threads; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+        n_wrong += checks[t].n_wrong;
+        failed |= checks[t].failed;
+    }
+    free(in);
+
+    if (n_wrong > 0) {
+        fprintf(stderr, "test-brighten: %lu wrong pixels\n", n_wrong);
+        failed = 1;
+    }
+    if (failed) {
+        return EXIT_FAILURE;
+    }
+    printf("test-brighten: %d amounts x %d colours OK\n",
+           MAX_AMOUNT - MIN_AMOUNT + 1, N_COLOURS);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+// Description: Check the colour-cached RGB brighten against brighten_rgb.
+//              The row operation is driven directly, as the brighten
+//              operation only picks it on CPUs without the vector kernel:
+//              by several threads sharing one cache, past the point where
+//              the cache fills and the rows fall back to brighten_rgb, and
+//              on rows starting with black, the colour the row's last
+//              result is seeded with. The row operation is static, so the
+//              file is included.
+
+#include "../aif-image.c"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH 1000
+#define ROWS_PER_THREAD 400
+// Threads sharing a cache; several even on one CPU, so they interleave
+#define N_THREADS 4
+// Distinct colours of the rows that fit the cache, and of those that
+// overflow it
+#define FEW_COLOURS (AIF_RGB_CACHE_MAX_COLOURS / 2)
+#define MANY_COLOURS (AIF_RGB_CACHE_MAX_COLOURS * 3)
+
+struct cache_check {
+    struct brighten_rgb_cached *cached;
+    int first_row;
+    uint32_t n_colours;
+    unsigned long n_wrong;
+};
+
+// Description: Fill a row with colours drawn from the first n_colours of a
+//              fixed palette, in runs of varied length, starting with
+//              black on every other row.
+// Params:
+// - row: row number, seeding the choice
+// - n_colours: palette colours to use
+// - pixels: WIDTH RGB8 pixels
+// Returns: void.
+static void make_row(uint32_t row, uint32_t n_colours, uint8_t *pixels) {
+    uint32_t x = row * 2654435761u + 1;
+    uint32_t colour = 0;
+    uint32_t run = 0;
+    for (size_t i = 0; i < WIDTH; i++) {
+        if (run == 0) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            // Palette colour k is spread over the whole cube
+            colour = ((x % n_colours) * 2654435761u) & 0xFFFFFF;
+            run = 1 + (x >> 29);
+            if (i == 0 && row % 2 == 0) {
+                colour = 0;
+            }
+        }
+        run--;
+        pixels[i * 3] = colour >> 16;
+        pixels[i * 3 + 1] = colour >> 8;
+        pixels[i * 3 + 2] = colour;
+    }
+}
+
+// Description: Brighten one thread's rows through the shared cache and
+//              compare every pixel with brighten_rgb.
+// Params:
+// - arg: struct cache_check
+// Returns: NULL; the number of wrong pixels is left in n_wrong.
+static void *check_rows(void *arg) {
+    struct cache_check *check = arg;
+    uint8_t in[WIDTH * 3];
+    uint8_t out[WIDTH * 3];
+    for (int r = check->first_row; r < check->first_row + ROWS_PER_THREAD; r++) {
+        make_row((uint32_t)r, check->n_colours, in);
+        brighten_rgb_cached_row(check->cached, in, out, WIDTH);
+        for (size_t i = 0; i < WIDTH * 3; i += 3) {
+            uint32_t colour = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+            uint32_t expected = brighten_rgb(colour, check->cached->amount);
+            uint32_t got = (out[i] << 16) | (out[i + 1] << 8) | out[i + 2];
+            if (got != expected) {
+                if (check->n_wrong < 10) {
+                    fprintf(stderr, "test-cache: row %d pixel %zu: %06x gave %06x, "
+                            "expected %06x\n", r, i / 3, colour, got, expected);
+                }
+                check->n_wrong++;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Description: Brighten rows on N_THREADS threads sharing one cache.
+// Params:
+// - amount: brighten/darken percentage
+// - n_colours: distinct colours of the rows
+// - full: whether the cache should end up full
+// Returns: number of failures found.
+static unsigned long check_cache(int amount, uint32_t n_colours, int full) {
+    struct brighten_rgb_cached cached = { amount, aif_rgb_cache_create() };
+    if (cached.cache == NULL) {
+        fprintf(stderr, "test-cache: out of memory\n");
+        return 1;
+    }
+
+    struct cache_check checks[N_THREADS];
+    pthread_t threads[N_THREADS];
+    int started[N_THREADS];
+    for (int t = 0; t < N_THREADS; t++) {
+        checks[t] = (struct cache_check){ &cached, t * ROWS_PER_THREAD, n_colours, 0 };
+        started[t] = pthread_create(&threads[t], NULL, check_rows, &checks[t]) == 0;
+    }
+    unsigned long n_wrong = 0;
+    for (int t = 0; t < N_THREADS; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            check_rows(&checks[t]);
+        }
+        n_wrong += checks[t].n_wrong;
+    }
+
+    if (aif_rgb_cache_full(cached.cache) != full) {
+        fprintf(stderr, "test-cache: %u colours by %d: cache %s full\n", n_colours, amount,
+                full ? "not" : "unexpectedly");
+        n_wrong++;
+    }
+    // Rows after the cache filled take the fallback; these must still
+    // come out right
+    if (full) {
+        struct cache_check after = { &cached, N_THREADS * ROWS_PER_THREAD, n_colours, 0 };
+        check_rows(&after);
+        n_wrong += after.n_wrong;
+    }
+
+    // Whatever the threads left in the cache must be right too
+    uint8_t in[WIDTH * 3];
+    for (int r = 0; r < N_THREADS * ROWS_PER_THREAD; r++) {
+        make_row((uint32_t)r, n_colours, in);
+        for (size_t i = 0; i < WIDTH * 3; i += 3) {
+            uint32_t colour = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+            uint32_t result;
+            if (aif_rgb_cache_get(cached.cache, colour, &result)
+                && result != brighten_rgb(colour, amount)) {
+                fprintf(stderr, "test-cache: cached %06x is %06x\n", colour, result);
+                n_wrong++;
+                break;
+            }
+        }
+    }
+    aif_rgb_cache_destroy(cached.cache);
+    return n_wrong;
+}
+
+// Description: Brighten rows of black, and rows that start black and
+//              return to it, where the seeded last result is all that is
+//              used.
+// Params:
+// - amount: brighten/darken percentage
+// Returns: number of failures found.
+static unsigned long check_black(int amount) {
+    struct brighten_rgb_cached cached = { amount, aif_rgb_cache_create() };
+    if (cached.cache == NULL) {
+        fprintf(stderr, "test-cache: out of memory\n");
+        return 1;
+    }
+    uint32_t colours[][3] = {
+        { 0x000000, 0x000000, 0x000000 },
+        { 0x000000, 0x102030, 0x000000 },
+        { 0x102030, 0x000000, 0x000000 },
+    };
+    unsigned long n_wrong = 0;
+    for (size_t c = 0; c < sizeof(colours) / sizeof(colours[0]); c++) {
+        uint8_t in[WIDTH * 3];
+        uint8_t out[WIDTH * 3];
+        for (size_t i = 0; i < WIDTH; i++) {
+            uint32_t colour = colours[c][i * 3 / WIDTH];
+            in[i * 3] = colour >> 16;
+            in[i * 3 + 1] = colour >> 8;
+            in[i * 3 + 2] = colour;
+        }
+        brighten_rgb_cached_row(&cached, in, out, WIDTH);
+        for (size_t i = 0; i < WIDTH; i++) {
+            uint32_t expected = brighten_rgb(colours[c][i * 3 / WIDTH], amount);
+            uint32_t got = (out[i * 3] << 16) | (out[i * 3 + 1] << 8) | out[i * 3 + 2];
+            if (got != expected) {
+                fprintf(stderr, "test-cache: black row %zu by %d: pixel %zu is %06x, "
+                        "expected %06x\n", c, amount, i, got, expected);
+                n_wrong++;
+                break;
+            }
+        }
+    }
+    aif_rgb_cache_destroy(cached.cache);
+    return n_wrong;
+}
+
+int main(void) {
+    int amounts[] = { -100, -37, 0, 25, 100 };
+    unsigned long n_wrong = 0;
+    for (size_t i = 0; i < sizeof(amounts) / sizeof(amounts[0]); i++) {
+        n_wrong += check_black(amounts[i]);
+        n_wrong += check_cache(amounts[i], FEW_COLOURS, FALSE);
+        n_wrong += check_cache(amounts[i], MANY_COLOURS, TRUE);
+    }
+    if (n_wrong > 0) {
+        fprintf(stderr, "test-cache: %lu failures\n", n_wrong);
+        return EXIT_FAILURE;
+    }
+    printf("test-cache: %zu amounts, %d threads, filling and overflowing OK\n",
+           sizeof(amounts) / sizeof(amounts[0]), N_THREADS);
+    return EXIT_SUCCESS;
+}
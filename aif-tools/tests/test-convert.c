@@ -0,0 +1,180 @@
+// Description: Check every pixel format conversion kernel the CPU can run
+//              against the scalar formulas: RGB8 to GRAY8 on all 2^24
+//              colours, GRAY8 to RGB8 on all 256 values, and both on every
+//              length up to a few vectors at every alignment, so that the
+//              tails are covered and no kernel writes past its output.
+//              The kernels are static, so the file is included.
+
+#include "../aif-convert.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_COLOURS (1 << 24)
+// Lengths checked one by one, a few of the widest vector step
+#define MAX_SHORT 100
+// Bytes after the output that must be left alone
+#define GUARD 64
+#define GUARD_BYTE 0xa5
+
+typedef void (*convert_fn)(const uint8_t *in, uint8_t *out, size_t n_pixels);
+
+struct kernel {
+    const char *name;
+    convert_fn rgb_to_gray;
+    convert_fn gray_to_rgb;
+    // Whether this CPU can run it
+    int supported;
+};
+
+// Description: Luma of one colour, straight from the formula.
+// Params:
+// - colour: 0xRRGGBB
+// Returns: gray value.
+static uint8_t expected_gray(uint32_t colour) {
+    uint32_t r = (colour >> 16) & 0xff;
+    uint32_t g = (colour >> 8) & 0xff;
+    uint32_t b = colour & 0xff;
+    return (uint8_t)((r * 299 + g * 587 + b * 114) / 1000);
+}
+
+// Description: Check that nothing was written past the output.
+// Params:
+// - out: output buffer
+// - n: bytes the conversion should have written
+// Returns: 1 if the guard bytes are intact, else 0.
+static int guard_intact(const uint8_t *out, size_t n) {
+    for (size_t i = n; i < n + GUARD; i++) {
+        if (out[i] != GUARD_BYTE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Description: Check one kernel's RGB8 to GRAY8 conversion.
+// Params:
+// - k: kernel
+// - rgb: all 2^24 colours as RGB8 pixels
+// - gray: output buffer of N_COLOURS + GUARD bytes
+// Returns: number of failures found.
+static unsigned long check_rgb_to_gray(const struct kernel *k, const uint8_t *rgb,
+                                       uint8_t *gray) {
+    unsigned long n_wrong = 0;
+    memset(gray, GUARD_BYTE, N_COLOURS + GUARD);
+    k->rgb_to_gray(rgb, gray, N_COLOURS);
+    for (uint32_t colour = 0; colour < N_COLOURS; colour++) {
+        if (gray[colour] != expected_gray(colour)) {
+            if (n_wrong < 10) {
+                fprintf(stderr, "test-convert: %s: %06x gave %u, expected %u\n",
+                        k->name, colour, gray[colour], expected_gray(colour));
+            }
+            n_wrong++;
+        }
+    }
+    if (!guard_intact(gray, N_COLOURS)) {
+        fprintf(stderr, "test-convert: %s: wrote past %d gray pixels\n", k->name, N_COLOURS);
+        n_wrong++;
+    }
+
+    // Short rows at every alignment of a vector step
+    for (size_t start = 0; start < 32; start++) {
+        for (size_t n = 0; n <= MAX_SHORT; n++) {
+            memset(gray, GUARD_BYTE, n + GUARD);
+            k->rgb_to_gray(rgb + start * 3, gray, n);
+            for (size_t i = 0; i < n; i++) {
+                if (gray[i] != expected_gray((uint32_t)(start + i))) {
+                    fprintf(stderr, "test-convert: %s: pixel %zu of %zu from %zu wrong\n",
+                            k->name, i, n, start);
+                    return n_wrong + 1;
+                }
+            }
+            if (!guard_intact(gray, n)) {
+                fprintf(stderr, "test-convert: %s: wrote past %zu gray pixels\n", k->name, n);
+                return n_wrong + 1;
+            }
+        }
+    }
+    return n_wrong;
+}
+
+// Description: Check one kernel's GRAY8 to RGB8 expansion.
+// Params:
+// - k: kernel
+// - rgb: output buffer of (256 + MAX_SHORT) * 3 + GUARD bytes
+// Returns: number of failures found.
+static unsigned long check_gray_to_rgb(const struct kernel *k, uint8_t *rgb) {
+    uint8_t gray[256 + MAX_SHORT];
+    for (size_t i = 0; i < sizeof(gray); i++) {
+        gray[i] = (uint8_t)i;
+    }
+
+    for (size_t start = 0; start < 32; start++) {
+        for (size_t n = 0; n <= 256 + MAX_SHORT - start; n++) {
+            // Every length up to MAX_SHORT, then only the longest, which
+            // holds every value
+            if (n > MAX_SHORT && n != 256 + MAX_SHORT - start) {
+                continue;
+            }
+            memset(rgb, GUARD_BYTE, n * 3 + GUARD);
+            k->gray_to_rgb(gray + start, rgb, n);
+            for (size_t i = 0; i < n * 3; i++) {
+                if (rgb[i] != gray[start + i / 3]) {
+                    fprintf(stderr, "test-convert: %s: byte %zu of %zu pixels from %zu wrong\n",
+                            k->name, i, n, start);
+                    return 1;
+                }
+            }
+            if (!guard_intact(rgb, n * 3)) {
+                fprintf(stderr, "test-convert: %s: wrote past %zu RGB pixels\n", k->name, n);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    struct kernel kernels[] = {
+        { "scalar", rgb_to_gray_scalar, gray_to_rgb_scalar, 1 },
+#ifdef AIF_CONVERT_X86
+        { "ssse3", rgb_to_gray_ssse3, gray_to_rgb_ssse3, __builtin_cpu_supports("ssse3") },
+        { "avx2", rgb_to_gray_avx2, gray_to_rgb_avx2, __builtin_cpu_supports("avx2") },
+#endif
+        { "dispatch", aif_rgb_to_gray, aif_gray_to_rgb, 1 },
+    };
+
+    uint8_t *rgb = malloc((size_t)N_COLOURS * 3);
+    uint8_t *out = malloc((size_t)N_COLOURS + GUARD);
+    uint8_t *rgb_out = malloc((256 + MAX_SHORT) * 3 + GUARD);
+    if (rgb == NULL || out == NULL || rgb_out == NULL) {
+        fprintf(stderr, "test-convert: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t colour = 0; colour < N_COLOURS; colour++) {
+        rgb[colour * 3] = colour >> 16;
+        rgb[colour * 3 + 1] = colour >> 8;
+        rgb[colour * 3 + 2] = colour;
+    }
+
+    unsigned long n_wrong = 0;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        const struct kernel *k = &kernels[i];
+        if (!k->supported) {
+            printf("test-convert: %s: not supported by this CPU, skipped\n", k->name);
+            continue;
+        }
+        unsigned long kernel_wrong = check_rgb_to_gray(k, rgb, out)
+                                   + check_gray_to_rgb(k, rgb_out);
+        if (kernel_wrong == 0) {
+            printf("test-convert: %s: %d colours OK\n", k->name, N_COLOURS);
+        }
+        n_wrong += kernel_wrong;
+    }
+
+    free(rgb);
+    free(out);
+    free(rgb_out);
+    return n_wrong > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
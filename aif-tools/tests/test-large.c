@@ -0,0 +1,436 @@
+// Description: Round-trip images larger than 4 GB, where any offset, size
+//              or count kept in 32 bits would wrap. An uncompressed image
+//              is made as a sparse file (ftruncate), zero but for noise in
+//              the rows around the 2 GB and 4 GB marks and at the end, and
+//              is then compressed to RLE with a row index and to tiles,
+//              and decompressed again. A noise image is then written as
+//              RLE and converted to tiles, so that the compressed files
+//              themselves, and the offsets in their row index and tile
+//              table, pass 4 GB. Checksums are checked against ones worked
+//              out independently, or against the ones the writer stored.
+//
+//              Needs about 9 GB of disk. Opt-in: run by `make test-large`.
+//
+//              Usage: test-large [directory for the files]
+
+#include "../aif.h"
+#include "../aif-image.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FALSE 0
+#define TRUE 1
+
+// 72000 rows of 20000 RGB8 pixels: 4.32 GB of pixels, and noise rows
+// that still fit the 2-byte row lengths of AIF_COMPRESSION_RLE
+#define WIDTH 20000
+#define HEIGHT 72000
+#define BPP 3
+#define ROW_BYTES ((size_t)WIDTH * BPP)
+// Rows written or compared at a time
+#define CHUNK_ROWS 16
+// Rows of noise on each side of the offsets the sparse image marks
+#define MARK_ROWS 1
+// Rows of the noise image checked after each conversion
+#define CHECK_EVERY 997
+
+static const char *dir = ".";
+
+// Description: Build the path of one of the test's files.
+// Params:
+// - name: file name
+// - path: receives the path
+// - size: size of path
+// Returns: path.
+static char *test_path(const char *name, char *path, size_t size) {
+    snprintf(path, size, "%s/test-large-%s.aif", dir, name);
+    return path;
+}
+
+// Description: Fill a row with the noise of one row of the test images
+//              (xorshift32, seeded by the row).
+// Params:
+// - row: row number
+// - out: ROW_BYTES bytes
+// Returns: void.
+static void noise_row(uint32_t row, uint8_t *out) {
+    uint32_t x = row + 1;
+    for (size_t i = 0; i < ROW_BYTES; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = x >> 24;
+    }
+}
+
+// Description: Check whether a row of the sparse image holds noise: the
+//              rows around the 2 GB and 4 GB file offsets and the last
+//              rows.
+// Params:
+// - row: row number
+// Returns: TRUE if the row holds noise, FALSE if it is zero.
+static int sparse_marked(uint32_t row) {
+    uint64_t marks[] = {
+        ((uint64_t)1 << 31) - AIF_HEADER_SIZE,
+        ((uint64_t)1 << 32) - AIF_HEADER_SIZE,
+        (uint64_t)HEIGHT * ROW_BYTES - 1,
+    };
+    for (size_t i = 0; i < sizeof(marks) / sizeof(marks[0]); i++) {
+        uint32_t mark = (uint32_t)(marks[i] / ROW_BYTES);
+        if (row + MARK_ROWS >= mark && row <= mark + MARK_ROWS) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Description: Choose the rows of the sparse image checked after each
+//              conversion: the noise rows and the zero rows next to them.
+// Params:
+// - row: row number
+// Returns: TRUE if the row is checked.
+static int sparse_checked(uint32_t row) {
+    return sparse_marked(row) || (row > 0 && sparse_marked(row - 1))
+           || sparse_marked(row + 1);
+}
+
+// Description: Choose the rows of the noise image checked after each
+//              conversion: every CHECK_EVERY rows and the last two.
+// Params:
+// - row: row number
+// Returns: TRUE if the row is checked.
+static int noise_checked(uint32_t row) {
+    return row % CHECK_EVERY == 0 || row + 2 >= HEIGHT;
+}
+
+// Description: The expected pixels of a row of the sparse image.
+// Params:
+// - row: row number
+// - out: ROW_BYTES bytes
+// Returns: void.
+static void sparse_row(uint32_t row, uint8_t *out) {
+    if (sparse_marked(row)) {
+        noise_row(row, out);
+    } else {
+        memset(out, 0, ROW_BYTES);
+    }
+}
+
+// Running checksum of a file that is zero but for the blocks added to it.
+// Byte i of an n-byte file adds itself to sum1 and n - i times itself to
+// sum2, so the zero bytes in between need no reading.
+struct sparse_checksum {
+    uint64_t file_size;
+    uint32_t sum1;
+    uint32_t sum2;
+};
+
+// Description: Add a non-zero block of the file to its checksum.
+// Params:
+// - c: checksum
+// - data: bytes of the block
+// - size: bytes in the block
+// - offset: file offset of the block
+// Returns: void.
+static void sparse_checksum_add(
+    struct sparse_checksum *c,
+    const uint8_t *data,
+    size_t size,
+    uint64_t offset
+) {
+    for (size_t i = 0; i < size; i++) {
+        uint64_t pos = offset + i;
+        uint32_t byte = data[i];
+        if (pos == AIF_CHECKSUM_OFFSET || pos == AIF_CHECKSUM_OFFSET + 1) {
+            byte = 0;
+        }
+        c->sum1 = (c->sum1 + byte) & 0xff;
+        c->sum2 = (c->sum2 + byte * ((c->file_size - pos) & 0xff)) & 0xff;
+    }
+}
+
+// Description: Make the sparse uncompressed image.
+// Params:
+// - filename: file to create
+// Returns: TRUE on success, FALSE (after printing why) on failure.
+static int make_sparse(const char *filename) {
+    uint64_t file_size = AIF_HEADER_SIZE + (uint64_t)HEIGHT * ROW_BYTES;
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(filename);
+        return FALSE;
+    }
+    int ok = ftruncate(fd, (off_t)file_size) == 0;
+
+    uint8_t header[AIF_HEADER_SIZE] = { 0 };
+    memcpy(header, AIF_MAGIC, AIF_MAGIC_SIZE);
+    header[AIF_PXL_FMT_OFFSET] = AIF_FMT_RGB8;
+    header[AIF_COMPRESSION_OFFSET] = AIF_COMPRESSION_NONE;
+    for (int i = 0; i < 4; i++) {
+        header[AIF_WIDTH_OFFSET + i] = (uint8_t)((uint32_t)WIDTH >> (8 * i));
+        header[AIF_HEIGHT_OFFSET + i] = (uint8_t)((uint32_t)HEIGHT >> (8 * i));
+        header[AIF_PXL_OFFSET_OFFSET + i] = (uint8_t)((uint32_t)AIF_HEADER_SIZE >> (8 * i));
+    }
+    struct sparse_checksum c = { file_size, 0, 0 };
+    sparse_checksum_add(&c, header, sizeof(header), 0);
+
+    uint8_t *row = malloc(ROW_BYTES);
+    ok = ok && row != NULL;
+    for (uint32_t r = 0; ok && r < HEIGHT; r++) {
+        if (!sparse_marked(r)) {
+            continue;
+        }
+        uint64_t offset = AIF_HEADER_SIZE + (uint64_t)r * ROW_BYTES;
+        noise_row(r, row);
+        sparse_checksum_add(&c, row, ROW_BYTES, offset);
+        ok = pwrite(fd, row, ROW_BYTES, (off_t)offset) == (ssize_t)ROW_BYTES;
+    }
+    free(row);
+
+    uint16_t checksum = (uint16_t)((c.sum2 << 8) | c.sum1);
+    header[AIF_CHECKSUM_OFFSET] = checksum & 0xff;
+    header[AIF_CHECKSUM_OFFSET + 1] = checksum >> 8;
+    ok = ok && pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    if (close(fd) != 0 || !ok) {
+        fprintf(stderr, "%s: could not write\n", filename);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Description: Check that a file's stored checksum is the one its bytes
+//              give, and that the file has the expected layout.
+// Params:
+// - filename: file to check
+// - compression: expected compression
+// - min_size: smallest acceptable file size
+// Returns: TRUE if it is, FALSE (after printing why) if not.
+static int check_info(const char *filename, int compression, uint64_t min_size) {
+    struct aif_info info;
+    int status = aif_read_info(filename, &info);
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        return FALSE;
+    }
+    if (info.stored_checksum != info.checksum) {
+        fprintf(stderr, "%s: checksum %04x, stored %04x\n", filename,
+                info.checksum, info.stored_checksum);
+        return FALSE;
+    }
+    if (info.compression != compression || info.width != WIDTH || info.height != HEIGHT
+        || info.file_size < min_size) {
+        fprintf(stderr, "%s: unexpected header or size\n", filename);
+        return FALSE;
+    }
+    if ((compression == AIF_COMPRESSION_RLE && info.row_index_interval == 0)
+        || (compression == AIF_COMPRESSION_TILED && info.tile_width == 0)) {
+        fprintf(stderr, "%s: row index or tile table missing\n", filename);
+        return FALSE;
+    }
+    printf("test-large: %s: %zu bytes, checksum %04x\n", filename, info.file_size,
+           info.checksum);
+    return TRUE;
+}
+
+// Description: Convert a whole image to another compression.
+// Params:
+// - in_file: image to read
+// - out_file: image to write
+// - compression: AIF_COMPRESSION_* of the output
+// Returns: TRUE on success, FALSE (after printing why) on failure.
+static int convert(const char *in_file, const char *out_file, int compression) {
+    struct aif_image *img;
+    int status = aif_image_open(&img, in_file);
+    if (status == AIF_OK) {
+        struct aif_transform t;
+        memset(&t, 0, sizeof(t));
+        t.compression = compression;
+        t.row_index = compression == AIF_COMPRESSION_RLE;
+        t.n_threads = 1;
+        status = aif_image_transform(img, out_file, &t);
+        aif_image_close(img);
+    }
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s -> %s: %s\n", in_file, out_file, aif_error_message(status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Description: Decode chosen rows of an image, each on its own (through
+//              the row index or tile table), and compare them with the
+//              expected pixels.
+// Params:
+// - filename: image to read
+// - checked: chooses the rows to check
+// - expected: fills in the expected pixels of a row
+// Returns: TRUE if they match, FALSE (after printing why) if not.
+static int check_rows(
+    const char *filename,
+    int (*checked)(uint32_t row),
+    void (*expected)(uint32_t row, uint8_t *out)
+) {
+    struct aif_image *img;
+    int status = aif_image_open(&img, filename);
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        return FALSE;
+    }
+    uint8_t *want = malloc(ROW_BYTES);
+    uint8_t *got = malloc(ROW_BYTES);
+    int ok = want != NULL && got != NULL;
+    for (uint32_t r = 0; ok && r < HEIGHT; r++) {
+        if (!checked(r)) {
+            continue;
+        }
+        expected(r, want);
+        if (aif_image_compression(img) == AIF_COMPRESSION_TILED) {
+            status = aif_image_read_region(img, 0, r, WIDTH, 1, got);
+        } else {
+            status = aif_image_seek_row(img, r);
+            if (status == AIF_OK) {
+                status = aif_image_read_rows(img, got, 1);
+            }
+        }
+        if (status != AIF_OK) {
+            fprintf(stderr, "%s: row %u: %s\n", filename, r, aif_error_message(status));
+            ok = FALSE;
+        } else if (memcmp(want, got, ROW_BYTES) != 0) {
+            fprintf(stderr, "%s: row %u differs\n", filename, r);
+            ok = FALSE;
+        }
+    }
+    free(want);
+    free(got);
+    aif_image_close(img);
+    return ok;
+}
+
+// Description: Compare the pixels of two uncompressed files.
+// Params:
+// - a_file: first file
+// - b_file: second file
+// Returns: TRUE if they hold the same bytes, FALSE (after printing why)
+//          if not.
+static int same_file(const char *a_file, const char *b_file) {
+    int a = open(a_file, O_RDONLY);
+    int b = open(b_file, O_RDONLY);
+    size_t chunk = CHUNK_ROWS * ROW_BYTES;
+    uint8_t *a_buf = malloc(chunk);
+    uint8_t *b_buf = malloc(chunk);
+    int ok = a >= 0 && b >= 0 && a_buf != NULL && b_buf != NULL;
+    for (off_t pos = 0; ok; pos += chunk) {
+        ssize_t a_len = pread(a, a_buf, chunk, pos);
+        ssize_t b_len = pread(b, b_buf, chunk, pos);
+        if (a_len < 0 || a_len != b_len || memcmp(a_buf, b_buf, a_len) != 0) {
+            fprintf(stderr, "%s and %s differ near %lld\n", a_file, b_file, (long long)pos);
+            ok = FALSE;
+        } else if (a_len == 0) {
+            break;
+        }
+    }
+    if (a >= 0) {
+        close(a);
+    }
+    if (b >= 0) {
+        close(b);
+    }
+    free(a_buf);
+    free(b_buf);
+    return ok;
+}
+
+// Description: Write the noise image as RLE with a row index.
+// Params:
+// - filename: file to create
+// Returns: TRUE on success, FALSE (after printing why) on failure.
+static int make_noise(const char *filename) {
+    struct aif_image *img;
+    int status = aif_image_create(&img, filename, AIF_FMT_RGB8, AIF_COMPRESSION_RLE,
+                                  WIDTH, HEIGHT);
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        return FALSE;
+    }
+    status = aif_image_set_row_index(img);
+    uint8_t *rows = malloc(CHUNK_ROWS * ROW_BYTES);
+    if (rows == NULL) {
+        status = AIF_ERR_NO_MEMORY;
+    }
+    for (uint32_t r = 0; status == AIF_OK && r < HEIGHT; r += CHUNK_ROWS) {
+        uint32_t n = HEIGHT - r < CHUNK_ROWS ? HEIGHT - r : CHUNK_ROWS;
+        for (uint32_t i = 0; i < n; i++) {
+            noise_row(r + i, rows + i * ROW_BYTES);
+        }
+        status = aif_image_write_rows(img, rows, n);
+    }
+    free(rows);
+    int close_status = aif_image_close(img);
+    if (status == AIF_OK) {
+        status = close_status;
+    }
+    if (status != AIF_OK) {
+        fprintf(stderr, "%s: %s\n", filename, aif_error_message(status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        dir = argv[1];
+    }
+    char sparse[4096];
+    char sparse_rle[4096];
+    char sparse_tiled[4096];
+    char sparse_back[4096];
+    char noise_rle[4096];
+    char noise_tiled[4096];
+    test_path("sparse", sparse, sizeof(sparse));
+    test_path("sparse-rle", sparse_rle, sizeof(sparse_rle));
+    test_path("sparse-tiled", sparse_tiled, sizeof(sparse_tiled));
+    test_path("sparse-back", sparse_back, sizeof(sparse_back));
+    test_path("noise-rle", noise_rle, sizeof(noise_rle));
+    test_path("noise-tiled", noise_tiled, sizeof(noise_tiled));
+    uint64_t pixel_bytes = (uint64_t)HEIGHT * ROW_BYTES;
+
+    // Sparse image: reading past 4 GB, checksumming it, and compressing
+    // and decompressing it again
+    int ok = make_sparse(sparse)
+             && check_info(sparse, AIF_COMPRESSION_NONE, pixel_bytes)
+             && check_rows(sparse, sparse_checked, sparse_row)
+             && convert(sparse, sparse_rle, AIF_COMPRESSION_RLE)
+             && check_info(sparse_rle, AIF_COMPRESSION_RLE, 0)
+             && check_rows(sparse_rle, sparse_checked, sparse_row)
+             && convert(sparse_rle, sparse_back, AIF_COMPRESSION_NONE)
+             && check_info(sparse_back, AIF_COMPRESSION_NONE, pixel_bytes)
+             && same_file(sparse, sparse_back);
+    unlink(sparse_back);
+    unlink(sparse_rle);
+    ok = ok && convert(sparse, sparse_tiled, AIF_COMPRESSION_TILED)
+         && check_info(sparse_tiled, AIF_COMPRESSION_TILED, 0)
+         && check_rows(sparse_tiled, sparse_checked, sparse_row);
+    unlink(sparse_tiled);
+    unlink(sparse);
+
+    // Noise image: compressed files, row index and tile table past 4 GB
+    ok = ok && make_noise(noise_rle)
+         && check_info(noise_rle, AIF_COMPRESSION_RLE, pixel_bytes)
+         && check_rows(noise_rle, noise_checked, noise_row)
+         && convert(noise_rle, noise_tiled, AIF_COMPRESSION_TILED)
+         && check_info(noise_tiled, AIF_COMPRESSION_TILED, pixel_bytes)
+         && check_rows(noise_tiled, noise_checked, noise_row);
+    unlink(noise_tiled);
+    unlink(noise_rle);
+
+    if (!ok) {
+        fprintf(stderr, "test-large: FAILED\n");
+        return EXIT_FAILURE;
+    }
+    printf("test-large: OK\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+// Description: Check every byte lookup kernel the CPU can run against the
+//              scalar loop: for the gray brighten table of every amount
+//              and for random tables, on every length up to a few vector
+//              steps at every alignment, in place as well as into another
+//              buffer, with guard bytes so that no kernel writes past its
+//              output. The kernels are static, so the file is included.
+
+#include "../aif-lut.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lengths checked one by one, a few of the widest vector step
+#define MAX_SHORT 300
+// Start offsets checked, one full vector step
+#define N_ALIGNS 64
+// Bytes of the long run that every table also maps
+#define LONG_SIZE (1 << 16)
+// Random tables checked besides the brighten tables
+#define N_RANDOM_TABLES 64
+// Bytes after the output that must be left alone
+#define GUARD 64
+#define GUARD_BYTE 0xa5
+
+typedef void (*lut_fn)(const uint8_t *lut, const uint8_t *in, uint8_t *out, size_t n);
+
+struct kernel {
+    const char *name;
+    lut_fn apply;
+    // Whether this CPU can run it
+    int supported;
+};
+
+// Description: Build the gray brighten table of an amount, as the
+//              brighten operation does.
+// Params:
+// - lut: AIF_LUT_SIZE entries to fill in
+// - amount: brighten/darken percentage (-100..100)
+// Returns: void.
+static void brighten_table(uint8_t *lut, int amount) {
+    for (int i = 0; i < AIF_LUT_SIZE; i++) {
+        int val = i + i * amount / 100;
+        lut[i] = (uint8_t)(val > 255 ? 255 : val < 0 ? 0 : val);
+    }
+}
+
+// Description: Fill bytes with noise (xorshift32).
+// Params:
+// - buf: destination
+// - n: number of bytes
+// - seed: non-zero seed
+// Returns: void.
+static void noise(uint8_t *buf, size_t n, uint32_t seed) {
+    uint32_t x = seed;
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = x >> 24;
+    }
+}
+
+// Description: Check that nothing was written past the output.
+// Params:
+// - out: output buffer
+// - n: bytes the lookup should have written
+// Returns: 1 if the guard bytes are intact, else 0.
+static int guard_intact(const uint8_t *out, size_t n) {
+    for (size_t i = n; i < n + GUARD; i++) {
+        if (out[i] != GUARD_BYTE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Description: Check one kernel with one table.
+// Params:
+// - k: kernel
+// - lut: table
+// - in: LONG_SIZE input bytes holding every value
+// - want: LONG_SIZE + GUARD bytes of scratch for the expected output
+// - got: LONG_SIZE + GUARD bytes of scratch for the kernel's output
+// Returns: 0 if the kernel matches the scalar loop, else 1 (after
+//          printing the first difference).
+static int check_table(const struct kernel *k, const uint8_t *lut, const uint8_t *in,
+                       uint8_t *want, uint8_t *got) {
+    lut_apply_scalar(lut, in, want, LONG_SIZE);
+    memset(got, GUARD_BYTE, LONG_SIZE + GUARD);
+    k->apply(lut, in, got, LONG_SIZE);
+    if (memcmp(want, got, LONG_SIZE) != 0 || !guard_intact(got, LONG_SIZE)) {
+        fprintf(stderr, "test-lut: %s: %d bytes wrong\n", k->name, LONG_SIZE);
+        return 1;
+    }
+
+    for (size_t start = 0; start < N_ALIGNS; start++) {
+        for (size_t n = 0; n <= MAX_SHORT; n++) {
+            lut_apply_scalar(lut, in + start, want, n);
+
+            memset(got, GUARD_BYTE, start % 32 + n + GUARD);
+            k->apply(lut, in + start, got + start % 32, n);
+            if (memcmp(want, got + start % 32, n) != 0
+                || !guard_intact(got + start % 32, n)) {
+                fprintf(stderr, "test-lut: %s: %zu bytes from %zu wrong\n", k->name, n,
+                        start);
+                return 1;
+            }
+
+            // In place, as the row operations may run it
+            memset(got, GUARD_BYTE, start + n + GUARD);
+            memcpy(got + start, in + start, n);
+            k->apply(lut, got + start, got + start, n);
+            if (memcmp(want, got + start, n) != 0 || !guard_intact(got + start, n)) {
+                fprintf(stderr, "test-lut: %s: %zu bytes from %zu wrong in place\n",
+                        k->name, n, start);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    struct kernel kernels[] = {
+#ifdef AIF_LUT_X86
+        { "avx2", lut_apply_avx2, __builtin_cpu_supports("avx2") },
+#endif
+        { "dispatch", aif_lut_apply, 1 },
+    };
+
+    uint8_t *in = malloc(LONG_SIZE);
+    uint8_t *want = malloc(LONG_SIZE + GUARD);
+    uint8_t *got = malloc(LONG_SIZE + GUARD);
+    if (in == NULL || want == NULL || got == NULL) {
+        fprintf(stderr, "test-lut: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    // Every value first, so that short runs see all of them too, then
+    // noise
+    for (int i = 0; i < AIF_LUT_SIZE; i++) {
+        in[i] = (uint8_t)(i * 167 + 13);
+    }
+    noise(in + AIF_LUT_SIZE, LONG_SIZE - AIF_LUT_SIZE, 1);
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        const struct kernel *k = &kernels[i];
+        if (!k->supported) {
+            printf("test-lut: %s: not supported by this CPU, skipped\n", k->name);
+            continue;
+        }
+        uint8_t lut[AIF_LUT_SIZE];
+        int kernel_failed = 0;
+        for (int amount = -100; amount <= 100 && !kernel_failed; amount++) {
+            brighten_table(lut, amount);
+            kernel_failed = check_table(k, lut, in, want, got);
+        }
+        for (uint32_t t = 0; t < N_RANDOM_TABLES && !kernel_failed; t++) {
+            noise(lut, AIF_LUT_SIZE, t + 1);
+            kernel_failed = check_table(k, lut, in, want, got);
+        }
+        if (!kernel_failed) {
+            printf("test-lut: %s: 201 brighten and %d random tables OK\n", k->name,
+                   N_RANDOM_TABLES);
+        }
+        failed |= kernel_failed;
+    }
+
+    free(in);
+    free(want);
+    free(got);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}